@@ -18,6 +18,10 @@
 #include "nrf_soc.h"
 #include "nrf_nvic.h"
 #include "fstorage.h"
+#include "app_scheduler.h"
+#include "app_util_platform.h"
+#include "app_timer.h"
+#include "crc32.h"
 #include "EPD_ble.h"
 #define NRF_LOG_MODULE_NAME "EPD_ble"
 #include "nrf_log.h"
@@ -35,6 +39,8 @@
 #define ARRAY_SIZE(arr)                    (sizeof(arr) / sizeof((arr)[0]))
 #define EPD_CONFIG_SIZE                    (sizeof(epd_config_t) / sizeof(uint8_t))
 
+APP_TIMER_DEF(m_refresh_timer_id);                    /**< gives up on a refresh the panel never finishes */
+
 static void fs_evt_handler(fs_evt_t const * const evt, fs_ret_t result)
 {
     NRF_LOG_DEBUG("fs_evt_handler: %d\n", result);
@@ -47,6 +53,50 @@ FS_REGISTER_CFG(fs_config_t fs_config) =
     .num_pages = 1,
 };
 
+/**
+ * Fingerprints of the frames put on screen are appended to the free words of
+ * the config page, so it is only erased once every few hundred refreshes.
+ * The last word written is the frame on screen, EPD_FINGERPRINT_NONE if unknown.
+ */
+#define EPD_CONFIG_WORDS                   ((sizeof(epd_config_t) + sizeof(uint32_t) - 1) / sizeof(uint32_t))
+#define EPD_FINGERPRINT_NONE               0x00000000
+#define EPD_FINGERPRINT_FREE               0xFFFFFFFF
+
+static uint32_t m_fingerprint = EPD_FINGERPRINT_NONE;  /**< fingerprint of the frame on screen, also the source of fs_store */
+static uint16_t m_fingerprint_slot = EPD_CONFIG_WORDS; /**< next free word of the config page */
+
+static uint32_t epd_config_save(epd_config_t *cfg);
+
+static void epd_fingerprint_load(void)
+{
+    uint16_t words = fs_config.p_end_addr - fs_config.p_start_addr;
+
+    m_fingerprint_slot = EPD_CONFIG_WORDS;
+    while (m_fingerprint_slot < words && fs_config.p_start_addr[m_fingerprint_slot] != EPD_FINGERPRINT_FREE)
+        m_fingerprint_slot++;
+    m_fingerprint = m_fingerprint_slot > EPD_CONFIG_WORDS ? fs_config.p_start_addr[m_fingerprint_slot - 1] : EPD_FINGERPRINT_NONE;
+}
+
+static uint32_t epd_fingerprint_store(void)
+{
+    if (m_fingerprint == EPD_FINGERPRINT_NONE && m_fingerprint_slot == EPD_CONFIG_WORDS) return NRF_SUCCESS;
+
+    return fs_store(&fs_config, fs_config.p_start_addr + m_fingerprint_slot++, &m_fingerprint, 1, NULL);
+}
+
+/**@brief Function for persisting the fingerprint of the frame on screen.
+ */
+static void epd_fingerprint_save(ble_epd_t * p_epd, uint32_t fingerprint)
+{
+    if (fingerprint == m_fingerprint) return;
+
+    m_fingerprint = fingerprint;
+    if (m_fingerprint_slot < fs_config.p_end_addr - fs_config.p_start_addr)
+        epd_fingerprint_store();
+    else
+        epd_config_save(&p_epd->config);              // log full, start over on a fresh page
+}
+
 static uint32_t epd_config_load(epd_config_t *cfg)
 {
     memcpy(cfg, fs_config.p_start_addr, sizeof(epd_config_t));
@@ -65,8 +115,14 @@ static uint32_t epd_config_save(epd_config_t *cfg)
     {
         return err_code;
     }
-    uint16_t const len = (sizeof(epd_config_t) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
-    return fs_store(&fs_config, fs_config.p_start_addr, (uint32_t *) cfg, len, NULL);
+    uint16_t const len = EPD_CONFIG_WORDS;
+    if ((err_code = fs_store(&fs_config, fs_config.p_start_addr, (uint32_t *) cfg, len, NULL)) != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+    // the erase took the fingerprint log with it
+    m_fingerprint_slot = EPD_CONFIG_WORDS;
+    return epd_fingerprint_store();
 }
 
 /**@brief Function for handling the @ref BLE_GAP_EVT_CONNECTED event from the S110 SoftDevice.
@@ -81,9 +137,37 @@ static void on_connect(ble_epd_t * p_epd, ble_evt_t * p_ble_evt)
         nrf_gpio_pin_toggle(p_epd->config.led_pin);
     }
     p_epd->conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+    p_epd->conn_params = p_ble_evt->evt.gap_evt.params.connected.conn_params;
+    p_epd->rx_credits = 0;
+    p_epd->rx_dropped = 0;
+    p_epd->status.received = 0;
+    p_epd->status.error = EPD_ERROR_NONE;
 }
 
 
+/**@brief Function for resetting the service state after a disconnect, executed from the scheduler.
+ */
+static void epd_disconnect_process(void * p_event_data, uint16_t event_size)
+{
+    ble_epd_t * p_epd = *(ble_epd_t **)p_event_data;
+
+    // leave partial mode, or the next data written to EPD ram lands in the old window
+    if (p_epd->image.remaining > 0)
+    {
+        p_epd->driver->write_image_end();
+        EPD_RamHashLost();
+    }
+    p_epd->image.remaining = 0;
+    p_epd->image.flags = 0;
+    // a refresh in progress is finished by its own event
+    if (p_epd->status.state != EPD_STATE_REFRESHING)
+        p_epd->status.state = EPD_STATE_IDLE;
+
+    // the driver is kept alive for an open frame transaction, otherwise EPD ram is lost with the reset
+    if (!p_epd->frame.open)
+        p_epd->frame_id = 0;
+}
+
 /**@brief Function for handling the @ref BLE_GAP_EVT_DISCONNECTED event from the S110 SoftDevice.
  *
  * @param[in] p_epd     EPD Service structure.
@@ -97,11 +181,743 @@ static void on_disconnect(ble_epd_t * p_epd, ble_evt_t * p_ble_evt)
         nrf_gpio_pin_toggle(p_epd->config.led_pin);
     }
     p_epd->conn_handle = BLE_CONN_HANDLE_INVALID;
+
+    // reset after the packets still queued are processed
+    if (app_sched_event_put(&p_epd, sizeof(p_epd), epd_disconnect_process) != NRF_SUCCESS)
+    {
+        NRF_LOG_WARNING("[EPD]: scheduler queue full\n");
+    }
+}
+
+static uint8_t epd_rx_count(ble_epd_t * p_epd)
+{
+    return (uint8_t)(p_epd->rx_head - p_epd->rx_tail);
+}
+
+/**@brief Function for notifying the current driver and its capabilities.
+ */
+static uint32_t epd_driver_send(ble_epd_t * p_epd)
+{
+    epd_driver_t * driver = p_epd->driver;
+    uint8_t data[12] = {EPD_NOTIFY_DRIVER, driver->id};
+    uint16_big_encode(driver->width, &data[2]);
+    uint16_big_encode(driver->height, &data[4]);
+    data[6] = driver->caps.planes;
+    data[7] = driver->caps.grey_levels;
+    data[8] = driver->caps.lut_slots;
+    data[9] = driver->caps.black_cmd;
+    data[10] = driver->caps.color_cmd;
+    data[11] = driver->caps.flags;
+    return ble_epd_string_send(p_epd, data, sizeof(data));
+}
+
+/**@brief Function for notifying the service status.
+ */
+static void epd_status_send(ble_epd_t * p_epd)
+{
+    uint8_t data[4 + sizeof(uint32_t) + sizeof(uint16_t) + 2] = {EPD_NOTIFY_STATUS};
+    data[1] = p_epd->status.state;
+    data[2] = p_epd->status.error;
+    data[3] = epd_rx_count(p_epd);
+    uint32_big_encode(p_epd->status.received, &data[4]);
+    uint16_big_encode(p_epd->status.busy_ms, &data[8]);
+    data[10] = (uint8_t)p_epd->status.temperature;
+    data[11] = p_epd->status.waveform;
+    ble_epd_string_send(p_epd, data, sizeof(data));
+}
+
+static void epd_state_set(ble_epd_t * p_epd, uint8_t state)
+{
+    if (p_epd->status.state == state) return;
+    p_epd->status.state = state;
+    epd_status_send(p_epd);
+}
+
+static void epd_error_set(ble_epd_t * p_epd, uint8_t error)
+{
+    p_epd->status.error = error;
+    epd_status_send(p_epd);
+}
+
+static uint32_t epd_frame_send(ble_epd_t * p_epd);
+static void epd_frame_set(ble_epd_t * p_epd, uint32_t id);
+static void epd_rx_schedule(ble_epd_t * p_epd);
+
+/**@brief Function for fingerprinting the frame in EPD ram as it would be shown in @p mode.
+ *
+ * @details Only a stream that wrote every plane shown from top to bottom stands for
+ *          the frame, after a reset or a delta the rest of EPD ram is unknown.
+ *
+ * @return EPD_FINGERPRINT_NONE if EPD ram is not covered by the stream.
+ */
+static uint32_t epd_fingerprint(ble_epd_t * p_epd, uint8_t mode)
+{
+    epd_driver_t * driver = p_epd->driver;
+    uint8_t planes[] = {driver->caps.black_cmd, mode == EPD_DISPLAY_GREY ? 0x10 : driver->caps.color_cmd};
+
+    for (uint8_t i = 0; i < ARRAY_SIZE(planes); i++)
+        if (planes[i] != 0 && EPD_RamHashRows(planes[i]) < driver->height)
+            return EPD_FINGERPRINT_NONE;
+
+    uint32_t fingerprint = EPD_RamHash() ^ ((uint32_t)p_epd->driver->id << 8 | mode);
+    if (fingerprint == EPD_FINGERPRINT_NONE || fingerprint == EPD_FINGERPRINT_FREE)
+        fingerprint = 1;
+    return fingerprint;
+}
+
+/**@brief Function for notifying a refresh skipped because the frame is already on screen.
+ */
+static void epd_unchanged_send(ble_epd_t * p_epd)
+{
+    uint8_t data[1 + sizeof(uint32_t)] = {EPD_NOTIFY_UNCHANGED};
+    uint32_big_encode(m_fingerprint, &data[1]);
+    ble_epd_string_send(p_epd, data, sizeof(data));
+}
+
+static void epd_refresh_time(ble_epd_t * p_epd)
+{
+    uint32_t ticks;
+    app_timer_cnt_diff_compute(app_timer_cnt_get(), p_epd->refresh_ticks, &ticks);
+    p_epd->status.busy_ms = ticks * 125 / 4096; // RTC1 runs at 32768 Hz (no prescaler)
+}
+
+/**@brief Function for finishing the refresh, reporting the state and the refresh duration.
+ *
+ * @details Processing of the receive queue is paused during the refresh and resumed here.
+ */
+static void epd_refresh_end(ble_epd_t * p_epd)
+{
+    if (p_epd->status.state != EPD_STATE_REFRESHING) return;
+
+    app_timer_stop(m_refresh_timer_id);
+    p_epd->driver->refresh_end();
+    // the grey LUT is only good for grey frames
+    if (p_epd->status.waveform == EPD_WAVEFORM_GREY)
+        p_epd->driver->set_waveform(EPD_WAVEFORM_OTP, p_epd->status.temperature);
+
+    epd_refresh_time(p_epd);
+    epd_fingerprint_save(p_epd, p_epd->refresh_fingerprint);
+    EPD_RamHashReset();
+    epd_state_set(p_epd, EPD_STATE_IDLE);
+
+    if (p_epd->frame.committed)
+    {
+        p_epd->frame.committed = false;
+        epd_frame_send(p_epd);
+    }
+
+    p_epd->rx_scheduled = false;
+    __DMB(); // a packet queued during the refresh was not scheduled by the BLE event handler
+    if (epd_rx_count(p_epd) > 0)
+        epd_rx_schedule(p_epd);
+}
+
+static void epd_refresh_process(void * p_event_data, uint16_t event_size)
+{
+    ble_epd_t * p_epd = *(ble_epd_t **)p_event_data;
+
+    // may be stale, ble_epd_refresh_wait() finishes a refresh without this event
+    if (p_epd->refresh_done)
+        epd_refresh_end(p_epd);
+}
+
+/**@brief Function for ending a refresh the panel did not finish in time.
+ *
+ * @details The receive queue is processed again, nothing is known to be on screen.
+ */
+static void epd_refresh_timeout(ble_epd_t * p_epd)
+{
+    if (p_epd->status.state != EPD_STATE_REFRESHING) return;
+
+    NRF_LOG_WARNING("[EPD]: refresh timed out\n");
+    p_epd->refresh_fingerprint = EPD_FINGERPRINT_NONE;
+    if (p_epd->frame.committed)
+    {
+        p_epd->frame.committed = false;
+        epd_frame_set(p_epd, 0);
+    }
+    p_epd->status.error = EPD_ERROR_REFRESH_TIMEOUT;  // notified with the state
+    epd_refresh_end(p_epd);
+}
+
+static void epd_refresh_timeout_process(void * p_event_data, uint16_t event_size)
+{
+    ble_epd_t * p_epd = *(ble_epd_t **)p_event_data;
+
+    // may be stale, the refresh can end while the event is queued
+    if (!p_epd->refresh_done)
+        epd_refresh_timeout(p_epd);
+}
+
+/**@brief Function for handling the refresh timer, called from the RTC1 interrupt.
+ */
+static void epd_refresh_timer_handler(void * p_context)
+{
+    ble_epd_t * p_epd = (ble_epd_t *)p_context;
+
+    if (app_sched_event_put(&p_epd, sizeof(p_epd), epd_refresh_timeout_process) != NRF_SUCCESS)
+    {
+        NRF_LOG_WARNING("[EPD]: scheduler queue full\n");
+    }
+}
+
+/**@brief Function for handling the release of BUSY, called from the GPIOTE interrupt.
+ */
+static void epd_refresh_done(void * p_context)
+{
+    ble_epd_t * p_epd = (ble_epd_t *)p_context;
+
+    p_epd->refresh_done = true;
+    if (app_sched_event_put(&p_epd, sizeof(p_epd), epd_refresh_process) != NRF_SUCCESS)
+    {
+        NRF_LOG_WARNING("[EPD]: scheduler queue full\n");
+    }
+}
+
+/**@brief Function for reading the panel temperature, it takes a BUSY wait.
+ */
+static void epd_temperature_read(ble_epd_t * p_epd)
+{
+    if (!(p_epd->driver->caps.flags & EPD_CAPS_TEMPERATURE) || !p_epd->driver->read_temperature(&p_epd->status.temperature))
+        p_epd->status.temperature = EPD_TEMPERATURE_UNKNOWN;
+}
+
+/**@brief Function for loading the full refresh waveform, by temperature if configured so.
+ *
+ * @details LUTs written by the host are left alone until the next INIT. The temperature
+ *          is only read for @ref EPD_WAVEFORM_AUTO, nothing else depends on it.
+ */
+static void epd_waveform_select(ble_epd_t * p_epd, uint8_t mode)
+{
+    epd_caps_t * caps = &p_epd->driver->caps;
+
+    p_epd->status.temperature = EPD_TEMPERATURE_UNKNOWN;
+    if (p_epd->lut_custom)
+        p_epd->status.waveform = EPD_WAVEFORM_HOST;
+    else if (!(caps->flags & EPD_CAPS_WAVEFORM))
+        p_epd->status.waveform = EPD_WAVEFORM_OTP;
+    else if (mode == EPD_DISPLAY_GREY && caps->grey_levels >= 4)
+        p_epd->status.waveform = p_epd->driver->set_waveform(EPD_WAVEFORM_GREY, p_epd->status.temperature);
+    else
+    {
+        if (p_epd->config.waveform == EPD_WAVEFORM_AUTO)
+            epd_temperature_read(p_epd);
+        p_epd->status.waveform = p_epd->driver->set_waveform(p_epd->config.waveform, p_epd->status.temperature);
+    }
+}
+
+/**@brief Function for starting a refresh of the EPD.
+ *
+ * @details The CPU sleeps in the main loop until the panel is done, see @ref epd_refresh_end.
+ *
+ * @param[in] mode  @ref EPD_DISPLAY_FULL or @ref EPD_DISPLAY_GREY.
+ */
+static void epd_refresh(ble_epd_t * p_epd, uint8_t mode)
+{
+    p_epd->refresh_fingerprint = epd_fingerprint(p_epd, mode);
+    if (p_epd->refresh_fingerprint != EPD_FINGERPRINT_NONE && p_epd->refresh_fingerprint == m_fingerprint)
+    {
+        NRF_LOG_INFO("[EPD]: frame unchanged, refresh skipped\n");
+        EPD_RamHashReset();
+        epd_unchanged_send(p_epd);
+        if (p_epd->frame.committed)
+        {
+            p_epd->frame.committed = false;
+            epd_frame_send(p_epd);
+        }
+        return;
+    }
+
+    epd_state_set(p_epd, EPD_STATE_REFRESHING);
+    epd_waveform_select(p_epd, mode);
+    p_epd->partial_count = 0;
+    p_epd->refresh_done = false;
+    p_epd->refresh_ticks = app_timer_cnt_get();
+    app_timer_start(m_refresh_timer_id, EPD_BUSY_TIMEOUT, p_epd);
+    p_epd->driver->refresh_start(epd_refresh_done, p_epd);
+}
+
+/**@brief Function for a fast refresh of a window: x(2) y(2) w(2) h(2), the whole screen if omitted.
+ *
+ * @details Takes well under a second, so it is done in place.
+ *
+ * @return false if the driver has no partial refresh or a full refresh is due.
+ */
+static bool epd_refresh_partial(ble_epd_t * p_epd, uint8_t * p_data, uint16_t length)
+{
+    uint8_t limit = p_epd->config.partial_limit == 0xFF ? BLE_EPD_PARTIAL_LIMIT : p_epd->config.partial_limit;
+    if (!(p_epd->driver->caps.flags & EPD_CAPS_PARTIAL) || p_epd->partial_count >= limit) return false;
+
+    uint16_t x = 0, y = 0, w = p_epd->driver->width, h = p_epd->driver->height;
+    if (length >= 8)
+    {
+        x = uint16_big_decode(&p_data[0]);
+        y = uint16_big_decode(&p_data[2]);
+        w = uint16_big_decode(&p_data[4]);
+        h = uint16_big_decode(&p_data[6]);
+    }
+
+    epd_state_set(p_epd, EPD_STATE_REFRESHING);
+    p_epd->status.temperature = EPD_TEMPERATURE_UNKNOWN;  // the fast waveform does not depend on it
+    p_epd->refresh_ticks = app_timer_cnt_get();
+    p_epd->driver->refresh_partial(x, y, w, h);
+    p_epd->partial_count++;
+
+    epd_refresh_time(p_epd);
+    // a window on top of an older frame, the screen no longer matches any fingerprint
+    epd_fingerprint_save(p_epd, EPD_FINGERPRINT_NONE);
+    EPD_RamHashReset();
+    epd_state_set(p_epd, EPD_STATE_IDLE);
+    return true;
+}
+
+void ble_epd_refresh_wait(ble_epd_t * p_epd)
+{
+    if (p_epd->status.state != EPD_STATE_REFRESHING) return;
+
+    uint32_t ticks = 0;
+    while (!p_epd->refresh_done && ticks < EPD_BUSY_TIMEOUT)
+    {
+        sd_app_evt_wait();                            // the refresh timer wakes us up at the latest
+        app_timer_cnt_diff_compute(app_timer_cnt_get(), p_epd->refresh_ticks, &ticks);
+    }
+    if (p_epd->refresh_done)
+        epd_refresh_end(p_epd);
+    else
+        epd_refresh_timeout(p_epd);
+}
+
+void ble_epd_display(ble_epd_t * p_epd)
+{
+    ble_epd_refresh_wait(p_epd);
+    epd_refresh(p_epd, EPD_DISPLAY_FULL);
+    ble_epd_refresh_wait(p_epd);
+}
+
+/**@brief Function for checking if a controller register is configuration lost in deep sleep.
+ *
+ * @details Commands that act (power, refresh, sleep) or hold image data are not kept.
+ */
+static bool epd_shadow_register(uint8_t cmd)
+{
+    switch (cmd)
+    {
+      case 0x00: case 0x01: case 0x03: case 0x06:     // panel, power, power off sequence, booster
+      case 0x20: case 0x21: case 0x22: case 0x23: case 0x24: case 0x25: // LUTs
+      case 0x30: case 0x41: case 0x50: case 0x51:     // PLL, temperature sensor, VCOM and data interval, low power detection
+      case 0x42: case 0x60: case 0x61: case 0x65:     // temperature sensor write, TCON, resolution, gate/source start
+      case 0x82: case 0xE0: case 0xE5:                // VCOM DC, cascade, forced temperature
+          return true;
+      default:
+          return false;
+    }
+}
+
+static void epd_shadow_clear(ble_epd_t * p_epd)
+{
+    p_epd->shadow_len = 0;
+    p_epd->shadow_open = BLE_EPD_SHADOW_SIZE;
+}
+
+/**@brief Function for recording a command sent by the host, the latest write of a register replaces the older one.
+ */
+static void epd_shadow_command(ble_epd_t * p_epd, uint8_t cmd)
+{
+    uint8_t * shadow = p_epd->shadow;
+    uint16_t i = 0;
+
+    p_epd->shadow_open = BLE_EPD_SHADOW_SIZE;
+    if (!epd_shadow_register(cmd)) return;
+
+    while (i < p_epd->shadow_len && shadow[i] != cmd)
+        i += 2 + shadow[i + 1];
+    if (i < p_epd->shadow_len)
+    {
+        uint16_t size = 2 + shadow[i + 1];
+        memmove(&shadow[i], &shadow[i + size], p_epd->shadow_len - i - size);
+        p_epd->shadow_len -= size;
+    }
+
+    if (p_epd->shadow_len + 2 > BLE_EPD_SHADOW_SIZE)
+    {
+        // can not be written back, only a reset brings the controller to a known state
+        NRF_LOG_WARNING("[EPD]: register shadow full\n");
+        EPD_SetAwake(false);
+        return;
+    }
+    p_epd->shadow_open = p_epd->shadow_len;
+    shadow[p_epd->shadow_len++] = cmd;
+    shadow[p_epd->shadow_len++] = 0;
+}
+
+static void epd_shadow_data(ble_epd_t * p_epd, uint8_t * p_data, uint16_t length)
+{
+    uint16_t open = p_epd->shadow_open;
+    if (open == BLE_EPD_SHADOW_SIZE) return;
+
+    if (p_epd->shadow_len + length > BLE_EPD_SHADOW_SIZE || p_epd->shadow[open + 1] + length > UINT8_MAX)
+    {
+        // a register can not be replayed half written, drop it
+        NRF_LOG_WARNING("[EPD]: register shadow full\n");
+        p_epd->shadow_len = open;
+        p_epd->shadow_open = BLE_EPD_SHADOW_SIZE;
+        EPD_SetAwake(false);
+        return;
+    }
+    memcpy(&p_epd->shadow[p_epd->shadow_len], p_data, length);
+    p_epd->shadow_len += length;
+    p_epd->shadow[open + 1] += length;
+}
+
+/**@brief Function for initializing the controller and writing back the registers the host configured.
+ *
+ * @details The reset is skipped by the driver while the controller is awake, any other
+ *          command sent by the host marks it for a reset.
+ */
+static void epd_init(ble_epd_t * p_epd)
+{
+    uint16_t i = 0;
+
+    p_epd->driver->init();
+    p_epd->lut_custom = false;
+    while (i < p_epd->shadow_len)
+    {
+        uint8_t cmd = p_epd->shadow[i];
+        uint8_t len = p_epd->shadow[i + 1];
+
+        p_epd->driver->send_command(cmd);
+        if (len > 0)
+            p_epd->driver->send_data(&p_epd->shadow[i + 2], len);
+        if (cmd == 0x00 || (cmd >= 0x20 && cmd <= 0x25))
+            p_epd->lut_custom = true;
+        i += 2 + len;
+    }
+    p_epd->shadow_open = BLE_EPD_SHADOW_SIZE;
+    epd_state_set(p_epd, EPD_STATE_IDLE);
+}
+
+/**@brief Function for notifying the result of the last sequenced image window.
+ */
+static void epd_image_status_send(ble_epd_t * p_epd)
+{
+    uint8_t data[] = {EPD_NOTIFY_IMAGE_STATUS, p_epd->image.status, p_epd->image.plane};
+    ble_epd_string_send(p_epd, data, sizeof(data));
+}
+
+/**@brief Function for asking the peer to go back to the expected sequence number.
+ */
+static void epd_image_nack_send(ble_epd_t * p_epd)
+{
+    uint8_t data[] = {EPD_NOTIFY_IMAGE_NACK, p_epd->image.seq};
+    p_epd->image.nacked = true;
+    ble_epd_string_send(p_epd, data, sizeof(data));
+}
+
+/**@brief Function for opening an image window.
+ *
+ * @details Header layout (big endian): plane(1) x(2) y(2) w(2) h(2) len(2) [encoding(1)]
+ *          [flags(1) crc32(4)].
+ *          Once the window is open, the next @p len bytes written to the characteristic
+ *          are image data and carry no command byte. With an encoding other than raw,
+ *          @p len counts the encoded bytes.
+ *          With @ref EPD_IMAGE_SEQUENCED set, the data comes in @ref EPD_CMD_IMAGE_DATA
+ *          packets instead and @p crc32 is checked against the decoded data. Within a frame
+ *          transaction, @p crc32 covers all frame data up to the end of this window.
+ */
+static void epd_image_begin(ble_epd_t * p_epd, uint8_t * p_data, uint16_t length)
+{
+    if (length < 11) return;
+
+    uint8_t  plane    = p_data[0];
+    uint16_t x        = uint16_big_decode(&p_data[1]);
+    uint16_t y        = uint16_big_decode(&p_data[3]);
+    uint16_t w        = uint16_big_decode(&p_data[5]);
+    uint16_t h        = uint16_big_decode(&p_data[7]);
+    uint16_t len      = uint16_big_decode(&p_data[9]);
+    uint8_t  encoding = length > 11 ? p_data[11] : EPD_IMAGE_RAW;
+    uint8_t  flags    = length > 12 ? p_data[12] : 0;
+
+    NRF_LOG_DEBUG("[EPD]: IMAGE plane=0x%02x x=%d y=%d w=%d h=%d len=%d\n", plane, x, y, w, h, len);
+    if (len == 0 || encoding > EPD_IMAGE_PACKBITS || ((flags & EPD_IMAGE_SEQUENCED) && length < 17) ||
+        !p_epd->driver->write_image_begin(plane, x, y, w, h))
+    {
+        epd_error_set(p_epd, EPD_ERROR_IMAGE_INVALID);
+        return;
+    }
+
+    epd_frame_set(p_epd, 0);
+    if (!(flags & EPD_IMAGE_SEQUENCED))
+        p_epd->frame.open = false;
+
+    p_epd->image.plane = plane;
+    p_epd->image.encoding = encoding;
+    p_epd->image.remaining = len;
+    p_epd->image.rle_count = 0;
+    p_epd->image.rle_run = false;
+    p_epd->image.flags = flags;
+    p_epd->image.seq = 0;
+    p_epd->image.nacked = false;
+    p_epd->image.status = EPD_IMAGE_INCOMPLETE;
+    p_epd->image.crc = p_epd->frame.open ? p_epd->frame.crc : 0;
+    p_epd->image.written = 0;
+    p_epd->image.size = (w + 7) / 8 * h;
+    p_epd->image.crc_expected = (flags & EPD_IMAGE_SEQUENCED) ? uint32_big_decode(&p_data[13]) : 0;
+
+    epd_state_set(p_epd, EPD_STATE_RECEIVING);
+}
+
+/**@brief Function for writing decoded data to the open image window.
+ */
+static void epd_image_output(ble_epd_t * p_epd, uint8_t * p_data, uint16_t length)
+{
+    if (p_epd->image.flags & EPD_IMAGE_SEQUENCED)
+        p_epd->image.crc = crc32_compute(p_data, length, &p_epd->image.crc);
+    p_epd->image.written += length;
+
+    p_epd->driver->send_data(p_data, length);
+}
+
+/**@brief Function for expanding PackBits data into the open image window.
+ *
+ * @details The decoder state is kept in @ref epd_image_t, so literals and runs may
+ *          span several packets.
+ */
+static void epd_image_unpack(ble_epd_t * p_epd, uint8_t * p_data, uint16_t length)
+{
+    epd_image_t * p_image = &p_epd->image;
+    uint8_t buf[BLE_EPD_MAX_DATA_LEN];
+    uint8_t n = 0;
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        uint8_t b = p_data[i];
+
+        if (p_image->rle_count == 0)
+        {
+            // header: 0..127 literal of n+1 bytes, 129..255 run of 257-n bytes, 128 no-op
+            if (b < 128)
+            {
+                p_image->rle_count = b + 1;
+                p_image->rle_run = false;
+            }
+            else if (b > 128)
+            {
+                p_image->rle_count = 257 - b;
+                p_image->rle_run = true;
+            }
+            continue;
+        }
+
+        do {
+            buf[n++] = b;
+            p_image->rle_count--;
+            if (n == sizeof(buf))
+            {
+                epd_image_output(p_epd, buf, n);
+                n = 0;
+            }
+        } while (p_image->rle_run && p_image->rle_count > 0);
+    }
+
+    if (n > 0) epd_image_output(p_epd, buf, n);
+}
+
+static void epd_image_write(ble_epd_t * p_epd, uint8_t * p_data, uint16_t length)
+{
+    if (length > p_epd->image.remaining)
+        length = p_epd->image.remaining;
+
+    if (p_epd->image.encoding == EPD_IMAGE_PACKBITS)
+        epd_image_unpack(p_epd, p_data, length);
+    else
+        epd_image_output(p_epd, p_data, length);
+    p_epd->image.remaining -= length;
+
+    if (p_epd->image.remaining == 0)
+    {
+        p_epd->driver->write_image_end();
+        // rows short of data keep what was there before
+        if (p_epd->image.written != p_epd->image.size)
+            EPD_RamHashLost();
+
+        if (p_epd->image.flags & EPD_IMAGE_SEQUENCED)
+        {
+            p_epd->image.status = (p_epd->image.crc == p_epd->image.crc_expected) ? EPD_IMAGE_OK : EPD_IMAGE_CRC_ERROR;
+            NRF_LOG_DEBUG("[EPD]: IMAGE status=%d\n", p_epd->image.status);
+            if (p_epd->image.status == EPD_IMAGE_CRC_ERROR)
+                epd_error_set(p_epd, EPD_ERROR_IMAGE_CRC);
+
+            // checkpoint the frame transaction
+            if (p_epd->frame.open && p_epd->image.status == EPD_IMAGE_OK)
+            {
+                p_epd->frame.offset += p_epd->image.written;
+                p_epd->frame.crc = p_epd->image.crc;
+            }
+            epd_image_status_send(p_epd);
+        }
+
+        if (!p_epd->frame.open)
+            epd_state_set(p_epd, EPD_STATE_IDLE);
+    }
+}
+
+/**@brief Function for handling a sequenced image data packet.
+ *
+ * @details Packets out of sequence are dropped and the peer is asked once to go back
+ *          to the expected one. A packet without data queries the window state.
+ */
+static void epd_image_data(ble_epd_t * p_epd, uint8_t * p_data, uint16_t length)
+{
+    if (!(p_epd->image.flags & EPD_IMAGE_SEQUENCED) || p_epd->image.remaining == 0)
+    {
+        epd_image_status_send(p_epd);
+        return;
+    }
+
+    if (length < 1)
+    {
+        epd_image_nack_send(p_epd);
+        return;
+    }
+
+    if (p_data[0] != p_epd->image.seq)
+    {
+        if (!p_epd->image.nacked) epd_image_nack_send(p_epd);
+        return;
+    }
+
+    p_epd->image.seq++;
+    p_epd->image.nacked = false;
+    epd_image_write(p_epd, &p_data[1], length - 1);
+}
+
+/**@brief Function for notifying the device address and the frame token.
+ *
+ * @details Web Bluetooth hides the device address, the host needs it to find the
+ *          last frame it sent to this device.
+ */
+static uint32_t epd_frame_send(ble_epd_t * p_epd)
+{
+    ble_gap_addr_t addr;
+    uint8_t data[1 + BLE_GAP_ADDR_LEN + sizeof(uint32_t)] = {EPD_NOTIFY_FRAME};
+
+    uint32_t err_code = sd_ble_gap_address_get(&addr);
+    if (err_code != NRF_SUCCESS) return err_code;
+
+    for (uint8_t i = 0; i < BLE_GAP_ADDR_LEN; i++)
+        data[1 + i] = addr.addr[BLE_GAP_ADDR_LEN - 1 - i];
+    uint32_big_encode(p_epd->frame_id, &data[1 + BLE_GAP_ADDR_LEN]);
+
+    return ble_epd_string_send(p_epd, data, sizeof(data));
+}
+
+/**@brief Function for changing the frame token, the host is told right away so it
+ *        never sends a delta against a frame that is gone.
+ */
+static void epd_frame_set(ble_epd_t * p_epd, uint32_t id)
+{
+    if (p_epd->frame_id == id) return;
+    p_epd->frame_id = id;
+    epd_frame_send(p_epd);
+}
+
+void ble_epd_frame_reset(ble_epd_t * p_epd)
+{
+    epd_frame_set(p_epd, 0);
+}
+
+/**@brief Function for notifying the parameters of the current connection.
+ */
+static uint32_t epd_conn_params_send(ble_epd_t * p_epd)
+{
+    uint8_t data[1 + 3 * sizeof(uint16_t)] = {EPD_NOTIFY_CONN_PARAMS};
+    uint16_big_encode(p_epd->conn_params.max_conn_interval, &data[1]);
+    uint16_big_encode(p_epd->conn_params.slave_latency, &data[3]);
+    uint16_big_encode(p_epd->conn_params.conn_sup_timeout, &data[5]);
+    return ble_epd_string_send(p_epd, data, sizeof(data));
+}
+
+/**@brief Function for notifying the id and acknowledged offset of the frame transaction.
+ */
+static void epd_frame_offset_send(ble_epd_t * p_epd)
+{
+    uint8_t data[1 + 2 * sizeof(uint32_t)] = {EPD_NOTIFY_FRAME_OFFSET};
+    uint32_big_encode(p_epd->frame.open ? p_epd->frame.id : 0, &data[1]);
+    uint32_big_encode(p_epd->frame.open ? p_epd->frame.offset : 0, &data[5]);
+    ble_epd_string_send(p_epd, data, sizeof(data));
+}
+
+/**@brief Function for opening or resuming a frame transaction.
+ *
+ * @details Layout (big endian): id(4) size(4) crc32(4). The frame is sent as sequenced
+ *          image windows; every window that passes its CRC32 is a checkpoint. Beginning
+ *          the open transaction again reports the offset to resume from.
+ */
+static void epd_frame_begin(ble_epd_t * p_epd, uint8_t * p_data, uint16_t length)
+{
+    if (length < 12) return;
+
+    uint32_t id = uint32_big_decode(&p_data[0]);
+    if (id == 0) return;
+
+    if (!p_epd->frame.open || p_epd->frame.id != id)
+    {
+        p_epd->frame.open = true;
+        p_epd->frame.id = id;
+        p_epd->frame.size = uint32_big_decode(&p_data[4]);
+        p_epd->frame.crc_expected = uint32_big_decode(&p_data[8]);
+        p_epd->frame.offset = 0;
+        p_epd->frame.crc = 0;
+    }
+
+    NRF_LOG_DEBUG("[EPD]: FRAME id=0x%08x offset=%d\n", id, p_epd->frame.offset);
+    epd_frame_offset_send(p_epd);
+    epd_state_set(p_epd, EPD_STATE_RECEIVING);
+}
+
+/**@brief Function for committing the frame transaction to the screen.
+ */
+static void epd_frame_commit(ble_epd_t * p_epd, uint8_t * p_data, uint16_t length)
+{
+    if (length < 4) return;
+
+    epd_frame_t * p_frame = &p_epd->frame;
+    if (!p_frame->open || p_frame->id != uint32_big_decode(p_data) || p_frame->offset != p_frame->size)
+    {
+        NRF_LOG_WARNING("[EPD]: FRAME commit refused, offset=%d\n", p_frame->offset);
+        epd_error_set(p_epd, EPD_ERROR_FRAME_INVALID);
+        epd_frame_offset_send(p_epd);
+        return;
+    }
+
+    if (p_frame->crc != p_frame->crc_expected)
+    {
+        NRF_LOG_WARNING("[EPD]: FRAME crc mismatch\n");
+        epd_error_set(p_epd, EPD_ERROR_FRAME_CRC);
+        p_frame->offset = 0;
+        p_frame->crc = 0;
+        epd_frame_offset_send(p_epd);
+        return;
+    }
+
+    p_frame->open = false;
+    // notified once the frame is on screen
+    p_epd->frame_id = p_frame->id;
+    p_frame->committed = true;
+    epd_refresh(p_epd, length > 4 ? p_data[4] : EPD_DISPLAY_FULL);
 }
 
 static void epd_service_process(ble_epd_t * p_epd, uint8_t * p_data, uint16_t length)
 {
     if (p_data == NULL || length <= 0) return;
+
+    // raw image data while an image window is open
+    if (p_epd->image.remaining > 0 && !(p_epd->image.flags & EPD_IMAGE_SEQUENCED))
+    {
+        epd_image_write(p_epd, p_data, length);
+        return;
+    }
+
     NRF_LOG_DEBUG("[EPD]: CMD=0x%02x, LEN=%d\n", p_data[0], length);
 
     if (p_epd->epd_cmd_cb != NULL) {
@@ -109,6 +925,51 @@ static void epd_service_process(ble_epd_t * p_epd, uint8_t * p_data, uint16_t le
             return;
     }
 
+    // the controller ignores everything in deep sleep until it is reset
+    if (p_epd->status.state == EPD_STATE_SLEEPING)
+    {
+        switch (p_data[0])
+        {
+          case EPD_CMD_CLEAR:
+          case EPD_CMD_SEND_COMMAND:
+          case EPD_CMD_WRITE_IMAGE:
+          case EPD_CMD_FRAME_BEGIN:
+              epd_init(p_epd);
+              break;
+          default:
+              break;
+        }
+    }
+
+    switch (p_data[0])
+    {
+      // these reset or overwrite EPD ram
+      case EPD_CMD_SET_PINS:
+      case EPD_CMD_INIT:
+      case EPD_CMD_CLEAR:
+      case EPD_CMD_SLEEP:
+          epd_frame_set(p_epd, 0);
+          p_epd->frame.open = false;
+          break;
+
+      // the host can not track what these do to EPD ram
+      case EPD_CMD_SEND_COMMAND:
+          // panel setting or LUT registers, the host manages the waveform
+          if (length > 1 && (p_data[1] == 0x00 || (p_data[1] >= 0x20 && p_data[1] <= 0x25)))
+              p_epd->lut_custom = true;
+          // display refresh behind our back
+          if (length > 1 && p_data[1] == 0x12)
+              epd_fingerprint_save(p_epd, EPD_FINGERPRINT_NONE);
+          epd_frame_set(p_epd, 0);
+          break;
+      case EPD_CMD_SEND_DATA:
+          epd_frame_set(p_epd, 0);
+          break;
+
+      default:
+          break;
+    }
+
     switch (p_data[0])
     {
       case EPD_CMD_SET_PINS:
@@ -136,34 +997,104 @@ static void epd_service_process(ble_epd_t * p_epd, uint8_t * p_data, uint16_t le
                   p_epd->driver = epd_driver_get();
                   p_epd->config.driver_id = p_epd->driver->id;
                   epd_config_save(&p_epd->config);
+                  epd_driver_send(p_epd);
               }
+              // start over from the controller defaults
+              epd_shadow_clear(p_epd);
+              EPD_SetAwake(false);
           }
 
           NRF_LOG_INFO("[EPD]: DRIVER=%d\n", p_epd->driver->id);
-          p_epd->driver->init();
+          epd_init(p_epd);
           break;
 
       case EPD_CMD_CLEAR:
+          p_epd->partial_count = 0;
+          epd_state_set(p_epd, EPD_STATE_REFRESHING);
           p_epd->driver->clear();
+          epd_fingerprint_save(p_epd, EPD_FINGERPRINT_NONE);
+          EPD_RamHashReset();
+          epd_state_set(p_epd, EPD_STATE_IDLE);
           break;
 
       case EPD_CMD_SEND_COMMAND:
           if (length < 2) return;
+          epd_shadow_command(p_epd, p_data[1]);
+          // partial mode, windows, power: not written back by INIT, only a reset undoes them
+          if (!epd_shadow_register(p_data[1]))
+              EPD_SetAwake(false);
           p_epd->driver->send_command(p_data[1]);
           break;
 
       case EPD_CMD_SEND_DATA:
+          // not register data, it goes wherever the controller's ram pointer is
+          if (p_epd->shadow_open == BLE_EPD_SHADOW_SIZE)
+              EPD_RamHashLost();
+          epd_shadow_data(p_epd, &p_data[1], length - 1);
           p_epd->driver->send_data(&p_data[1], length - 1);
           break;
 
+      case EPD_CMD_WRITE_IMAGE:
+          epd_image_begin(p_epd, &p_data[1], length - 1);
+          break;
+
+      case EPD_CMD_IMAGE_DATA:
+          epd_image_data(p_epd, &p_data[1], length - 1);
+          break;
+
+      case EPD_CMD_FRAME_BEGIN:
+          epd_frame_begin(p_epd, &p_data[1], length - 1);
+          break;
+
+      case EPD_CMD_FRAME_COMMIT:
+          epd_frame_commit(p_epd, &p_data[1], length - 1);
+          break;
+
+      case EPD_CMD_SET_FRAME:
+          if (length < 5) return;
+          epd_frame_set(p_epd, uint32_big_decode(&p_data[1]));
+          break;
+
       case EPD_CMD_DISPLAY:
-          p_epd->driver->refresh();
+          if ((p_epd->image.flags & EPD_IMAGE_SEQUENCED) && p_epd->image.status != EPD_IMAGE_OK)
+          {
+              NRF_LOG_WARNING("[EPD]: DISPLAY refused, image status=%d\n", p_epd->image.status);
+              epd_error_set(p_epd, EPD_ERROR_DISPLAY_REFUSED);
+              epd_image_status_send(p_epd);
+              return;
+          }
+          if (length > 1 && p_data[1] == EPD_DISPLAY_PARTIAL && epd_refresh_partial(p_epd, &p_data[2], length - 2))
+              break;
+          epd_refresh(p_epd, length > 1 ? p_data[1] : EPD_DISPLAY_FULL);
           break;
 
       case EPD_CMD_SLEEP:
           p_epd->driver->sleep();
+          epd_state_set(p_epd, EPD_STATE_SLEEPING);
           break;
 
+      case EPD_CMD_BATCH:
+      {
+          uint16_t i = 1;
+          while (i < length)
+          {
+              uint8_t len = p_data[i++];
+              if (len == 0 || i + len > length || p_data[i] == EPD_CMD_BATCH) break;
+              // an image window would take the rest of the batch as its data
+              if (p_data[i] == EPD_CMD_WRITE_IMAGE || p_data[i] == EPD_CMD_IMAGE_DATA)
+              {
+                  epd_error_set(p_epd, EPD_ERROR_IMAGE_INVALID);
+                  break;
+              }
+              epd_service_process(p_epd, &p_data[i], len);
+              i += len;
+              // the rest of the batch can not wait for the queue to resume
+              if (i < length)
+                  ble_epd_refresh_wait(p_epd);
+          }
+          break;
+      }
+
       case EPD_CMD_SET_CONFIG:
           if (length < 2) return;
           memcpy(&p_epd->config, &p_data[1], (length - 1 > EPD_CONFIG_SIZE) ? EPD_CONFIG_SIZE : length - 1);
@@ -190,6 +1121,118 @@ static void epd_service_process(ble_epd_t * p_epd, uint8_t * p_data, uint16_t le
     }
 }
 
+/**@brief Function for granting the freed receive credits to the peer.
+ *
+ * @details Credits that could not be notified (no notification enabled or no TX buffers
+ *          available) are kept and sent again later.
+ */
+static void epd_credits_send(ble_epd_t * p_epd)
+{
+    uint8_t credits;
+
+    CRITICAL_REGION_ENTER();
+    credits = p_epd->rx_credits;
+    p_epd->rx_credits = 0;
+    CRITICAL_REGION_EXIT();
+
+    if (credits == 0) return;
+
+    uint8_t data[] = {EPD_NOTIFY_CREDITS, credits};
+    if (ble_epd_string_send(p_epd, data, sizeof(data)) != NRF_SUCCESS)
+    {
+        CRITICAL_REGION_ENTER();
+        p_epd->rx_credits += credits;
+        CRITICAL_REGION_EXIT();
+    }
+}
+
+static void epd_rx_process(void * p_event_data, uint16_t event_size);
+
+/**@brief Function for scheduling the processing of the received packets.
+ *
+ * @details May run from both the BLE event handler and the scheduler, an extra
+ *          scheduler event only finds an empty queue.
+ */
+static void epd_rx_schedule(ble_epd_t * p_epd)
+{
+    p_epd->rx_scheduled = true;
+    if (app_sched_event_put(&p_epd, sizeof(p_epd), epd_rx_process) != NRF_SUCCESS)
+    {
+        p_epd->rx_scheduled = false;
+    }
+}
+
+/**@brief Function for processing the received packets, executed from the scheduler.
+ *
+ * @details The queue is a single producer, single consumer ring: the BLE event handler
+ *          only moves rx_head, this function only moves rx_tail. At most
+ *          BLE_EPD_RX_BATCH_SIZE packets are processed before the scheduler gets a turn.
+ */
+static void epd_rx_process(void * p_event_data, uint16_t event_size)
+{
+    ble_epd_t * p_epd = *(ble_epd_t **)p_event_data;
+
+    for (uint8_t n = 0; n < BLE_EPD_RX_BATCH_SIZE && epd_rx_count(p_epd) > 0; n++)
+    {
+        if (p_epd->status.state == EPD_STATE_REFRESHING) break;
+
+        epd_packet_t * p_packet = &p_epd->rx_queue[p_epd->rx_tail % BLE_EPD_RX_QUEUE_SIZE];
+        epd_service_process(p_epd, p_packet->data, p_packet->len);
+        __DMB(); // slot is free only after it was processed
+        p_epd->rx_tail++;
+
+        CRITICAL_REGION_ENTER();
+        p_epd->rx_credits++;
+        CRITICAL_REGION_EXIT();
+    }
+
+    epd_credits_send(p_epd);
+
+    // the queue is left alone while the panel refreshes, rx_scheduled stays set until it is done
+    if (p_epd->status.state == EPD_STATE_REFRESHING) return;
+
+    p_epd->rx_scheduled = false;
+    __DMB(); // a packet queued before this point was not scheduled by the BLE event handler
+    if (epd_rx_count(p_epd) > 0)
+        epd_rx_schedule(p_epd);
+}
+
+/**@brief Function for notifying the number of packets dropped on a full receive queue.
+ */
+static void epd_rx_overflow_send(ble_epd_t * p_epd)
+{
+    uint8_t data[1 + sizeof(uint16_t)] = {EPD_NOTIFY_RX_OVERFLOW};
+    uint16_big_encode(p_epd->rx_dropped, &data[1]);
+    ble_epd_string_send(p_epd, data, sizeof(data));
+}
+
+/**@brief Function for queueing a received packet, called from the BLE event handler.
+ */
+static void epd_rx_put(ble_epd_t * p_epd, uint8_t * p_data, uint16_t length)
+{
+    if (length > BLE_EPD_MAX_DATA_LEN) return;
+
+    if (epd_rx_count(p_epd) >= BLE_EPD_RX_QUEUE_SIZE)
+    {
+        NRF_LOG_WARNING("[EPD]: RX queue full, packet dropped\n");
+        p_epd->rx_dropped++;
+        p_epd->status.error = EPD_ERROR_RX_OVERFLOW;
+        epd_rx_overflow_send(p_epd);
+        return;
+    }
+
+    p_epd->status.received += length;
+
+    epd_packet_t * p_packet = &p_epd->rx_queue[p_epd->rx_head % BLE_EPD_RX_QUEUE_SIZE];
+    memcpy(p_packet->data, p_data, length);
+    p_packet->len = length;
+    __DMB(); // publish the packet before the new head
+    p_epd->rx_head++;
+
+    if (!p_epd->rx_scheduled)
+        epd_rx_schedule(p_epd);
+}
+
 /**@brief Function for handling the @ref BLE_GATTS_EVT_WRITE event from the S110 SoftDevice.
  *
  * @param[in] p_epd     EPD Service structure.
@@ -208,13 +1251,37 @@ static void on_write(ble_epd_t * p_epd, ble_evt_t * p_ble_evt)
     {
         if (ble_srv_is_notification_enabled(p_evt_write->data))
         {
+            uint8_t data[1 + sizeof(epd_config_t)] = {EPD_NOTIFY_CONFIG};
+            memcpy(&data[1], &p_epd->config, sizeof(epd_config_t));
+
             p_epd->is_notification_enabled = true;
-            static uint16_t length = sizeof(epd_config_t);
-            err_code = ble_epd_string_send(p_epd, (uint8_t *)&p_epd->config, length);
+            err_code = ble_epd_string_send(p_epd, data, sizeof(data));
             if (err_code != NRF_ERROR_INVALID_STATE)
             {
                 APP_ERROR_CHECK(err_code);
             }
+            err_code = epd_driver_send(p_epd);
+            if (err_code != NRF_ERROR_INVALID_STATE && err_code != BLE_ERROR_NO_TX_PACKETS)
+            {
+                APP_ERROR_CHECK(err_code);
+            }
+            err_code = epd_frame_send(p_epd);
+            if (err_code != NRF_ERROR_INVALID_STATE && err_code != BLE_ERROR_NO_TX_PACKETS)
+            {
+                APP_ERROR_CHECK(err_code);
+            }
+            err_code = epd_conn_params_send(p_epd);
+            if (err_code != NRF_ERROR_INVALID_STATE && err_code != BLE_ERROR_NO_TX_PACKETS)
+            {
+                APP_ERROR_CHECK(err_code);
+            }
+            epd_status_send(p_epd);
+
+            // grant the whole free queue to the peer
+            CRITICAL_REGION_ENTER();
+            p_epd->rx_credits = BLE_EPD_RX_QUEUE_SIZE - epd_rx_count(p_epd);
+            CRITICAL_REGION_EXIT();
+            epd_credits_send(p_epd);
         }
         else
         {
@@ -223,7 +1290,7 @@ static void on_write(ble_epd_t * p_epd, ble_evt_t * p_ble_evt)
     }
     else if (p_evt_write->handle == p_epd->char_handles.value_handle)
     {
-        epd_service_process(p_epd, p_evt_write->data, p_evt_write->len);
+        epd_rx_put(p_epd, p_evt_write->data, p_evt_write->len);
     }
     else
     {
@@ -253,6 +1320,17 @@ void ble_epd_on_ble_evt(ble_epd_t * p_epd, ble_evt_t * p_ble_evt)
             on_write(p_epd, p_ble_evt);
             break;
 
+        case BLE_EVT_TX_COMPLETE:
+            epd_credits_send(p_epd);
+            break;
+
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+            p_epd->conn_params = p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params;
+            NRF_LOG_INFO("[EPD]: conn interval=%d latency=%d timeout=%d\n", p_epd->conn_params.max_conn_interval,
+                         p_epd->conn_params.slave_latency, p_epd->conn_params.conn_sup_timeout);
+            epd_conn_params_send(p_epd);
+            break;
+
         default:
             // No implementation needed.
             break;
@@ -367,6 +1445,11 @@ void ble_epd_sleep_prepare(ble_epd_t * p_epd)
     }
 }
 
+bool ble_epd_is_busy(ble_epd_t * p_epd)
+{
+    return epd_rx_count(p_epd) > 0 || p_epd->image.remaining > 0;
+}
+
 uint32_t ble_epd_init(ble_epd_t * p_epd, epd_callback_t cmd_cb)
 {
     if (p_epd == NULL)
@@ -378,6 +1461,8 @@ uint32_t ble_epd_init(ble_epd_t * p_epd, epd_callback_t cmd_cb)
     // Initialize the service structure.
     p_epd->conn_handle             = BLE_CONN_HANDLE_INVALID;
     p_epd->is_notification_enabled = false;
+    p_epd->status.temperature      = EPD_TEMPERATURE_UNKNOWN;
+    epd_shadow_clear(p_epd);
 
     uint32_t                err_code;
     err_code = epd_config_load(&p_epd->config);
@@ -385,6 +1470,13 @@ uint32_t ble_epd_init(ble_epd_t * p_epd, epd_callback_t cmd_cb)
     {
         epd_config_init(p_epd);
     }
+    epd_fingerprint_load();
+
+    err_code = app_timer_create(&m_refresh_timer_id, APP_TIMER_MODE_SINGLE_SHOT, epd_refresh_timer_handler);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
 
     // Init led pin
     if (p_epd->config.led_pin != 0xFF)
@@ -23,6 +23,17 @@
 #define BLE_UUID_EPD_SERVICE  0x0001
 #define EPD_SERVICE_UUID_TYPE BLE_UUID_TYPE_VENDOR_BEGIN
 #define BLE_EPD_MAX_DATA_LEN  (GATT_MTU_SIZE_DEFAULT - 3) /**< Maximum length of data (in bytes) that can be transmitted to the peer. */
+/**
+ * RAM: next to S130 the application has 11320 bytes of the 16 KB nRF51822 (see
+ * armgcc_s130_nrf51822_xxaa.ld). The stack takes 2048, the calendar page buffer
+ * CALENDAR_BUFFER_SIZE 3600, the heap 512 and ble_epd_t about 800, of which 320 is
+ * the register shadow and 336 the RX queue (16 packets of 21 bytes). About 4 KB are
+ * left for the SDK modules and the rest of the application.
+ */
+#define BLE_EPD_RX_QUEUE_SIZE 16                      /**< Number of received packets buffered before they are processed, must be a power of 2. */
+#define BLE_EPD_RX_BATCH_SIZE 4                       /**< Number of packets processed per scheduler event. */
+#define BLE_EPD_PARTIAL_LIMIT 5                       /**< Default number of partial refreshes before a full refresh. */
+#define BLE_EPD_SHADOW_SIZE   320                     /**< Bytes of host written controller registers kept for replay, fits all 6 LUTs and the usual settings. */
 
 typedef bool (*epd_callback_t)(uint8_t cmd, uint8_t *data, uint16_t len);
 
@@ -39,8 +50,10 @@ typedef struct
     uint8_t driver_id;
     uint8_t wakeup_pin;
     uint8_t led_pin;
+    uint8_t partial_limit;                            /**< partial refreshes before a full one is forced, 0: never, 0xFF: default */
+    uint8_t waveform;                                 /**< full refresh waveform, 0 or 0xFF (unset): OTP LUT, 0xFD: picked by temperature */
     
-    uint8_t reserved[6];
+    uint8_t reserved[4];
 } epd_config_t;
 
 /**< EPD Service command IDs. */
@@ -53,6 +66,13 @@ enum EPD_CMDS
     EPD_CMD_SEND_DATA,                                /**< send data to EPD */
     EPD_CMD_DISPLAY,                                  /**< diaplay EPD ram on screen */
     EPD_CMD_SLEEP,                                    /**< EPD enter sleep mode */
+    EPD_CMD_BATCH,                                    /**< length prefixed commands: len(1) cmd(1) data(len-1) ..., no image commands */
+
+    EPD_CMD_WRITE_IMAGE = 0x10,                       /**< open an image window, following packets are image data */
+    EPD_CMD_SET_FRAME = 0x11,                         /**< tag the frame in EPD ram with a host token */
+    EPD_CMD_IMAGE_DATA = 0x12,                        /**< sequenced image data: seq(1) data, no data to query the state */
+    EPD_CMD_FRAME_BEGIN = 0x13,                       /**< open or resume a frame transaction: id(4) size(4) crc32(4) */
+    EPD_CMD_FRAME_COMMIT = 0x14,                      /**< verify and display the frame transaction: id(4) [mode(1)] */
 	
 	EPD_CMD_SET_TIME = 0x20,                          /** < set time with unix timestamp */
 
@@ -62,6 +82,121 @@ enum EPD_CMDS
     EPD_CMD_CFG_ERASE  = 0x99,                        /**< Erase config and reset */
 };
 
+/**< EPD Service notification IDs. */
+enum EPD_NOTIFY
+{
+    EPD_NOTIFY_CONFIG,                                /**< current EPD config */
+    EPD_NOTIFY_CREDITS,                               /**< number of packets the peer may send in addition */
+    EPD_NOTIFY_FRAME,                                 /**< device address and token of the frame in EPD ram */
+    EPD_NOTIFY_IMAGE_NACK,                            /**< sequence number expected by a sequenced image window */
+    EPD_NOTIFY_IMAGE_STATUS,                          /**< result of the last sequenced image window */
+    EPD_NOTIFY_FRAME_OFFSET,                          /**< id and acknowledged offset of the frame transaction */
+    EPD_NOTIFY_CONN_PARAMS,                           /**< current connection interval, slave latency and supervision timeout */
+    EPD_NOTIFY_RX_OVERFLOW,                           /**< packets dropped because the receive queue was full */
+    EPD_NOTIFY_STATUS,                                /**< device status, see @ref epd_status_t */
+    EPD_NOTIFY_DRIVER,                                /**< current driver: id(1) width(2) height(2) planes(1) grey_levels(1) lut_slots(1) black_cmd(1) color_cmd(1) flags(1) */
+    EPD_NOTIFY_UNCHANGED,                             /**< refresh skipped, the frame in EPD ram is already on screen: fingerprint(4) */
+};
+
+/**< EPD Service states. */
+enum EPD_STATE
+{
+    EPD_STATE_IDLE,                                   /**< waiting for commands */
+    EPD_STATE_RECEIVING,                              /**< image window or frame transaction open */
+    EPD_STATE_REFRESHING,                             /**< waiting for the EPD refresh to finish */
+    EPD_STATE_SLEEPING,                               /**< EPD in deep sleep */
+};
+
+/**< EPD Service errors. */
+enum EPD_ERROR
+{
+    EPD_ERROR_NONE,                                   /**< no error */
+    EPD_ERROR_RX_OVERFLOW,                            /**< packet dropped on a full receive queue */
+    EPD_ERROR_IMAGE_INVALID,                          /**< image window rejected */
+    EPD_ERROR_IMAGE_CRC,                              /**< image window CRC32 mismatch */
+    EPD_ERROR_FRAME_INVALID,                          /**< frame commit refused */
+    EPD_ERROR_FRAME_CRC,                              /**< frame CRC32 mismatch */
+    EPD_ERROR_DISPLAY_REFUSED,                        /**< display refused on an incomplete image */
+    EPD_ERROR_REFRESH_TIMEOUT,                        /**< BUSY was not released within EPD_BUSY_TIMEOUT */
+};
+
+/**< Refresh modes of the DISPLAY command: mode(1) [x(2) y(2) w(2) h(2)], and of FRAME_COMMIT: id(4) [mode(1)] */
+enum EPD_DISPLAY_MODE
+{
+    EPD_DISPLAY_FULL,                                 /**< full refresh with the OTP LUT */
+    EPD_DISPLAY_PARTIAL,                              /**< fast refresh of a window, whole screen if no window is given */
+    EPD_DISPLAY_GREY,                                 /**< full refresh with 4 grey levels, DTM1 and DTM2 hold the two bits of each pixel */
+};
+
+/**< Image data encodings. */
+enum EPD_IMAGE_ENCODING
+{
+    EPD_IMAGE_RAW,                                    /**< plain plane data */
+    EPD_IMAGE_PACKBITS,                               /**< PackBits run-length encoded plane data */
+};
+
+/**< Image window flags. */
+enum EPD_IMAGE_FLAGS
+{
+    EPD_IMAGE_SEQUENCED = 0x01,                       /**< data comes in EPD_CMD_IMAGE_DATA packets and is checked with CRC32 */
+};
+
+/**< Sequenced image window status. */
+enum EPD_IMAGE_STATUS
+{
+    EPD_IMAGE_OK,                                     /**< all data received, CRC32 matches */
+    EPD_IMAGE_CRC_ERROR,                              /**< all data received, CRC32 mismatch */
+    EPD_IMAGE_INCOMPLETE,                             /**< data still missing */
+};
+
+/**< Received packet */
+typedef struct
+{
+    uint8_t                  len;                     /**< packet length */
+    uint8_t                  data[BLE_EPD_MAX_DATA_LEN]; /**< packet data */
+} epd_packet_t;
+
+/**< EPD image window state */
+typedef struct
+{
+    uint8_t                  plane;                   /**< data transmission command of the plane being written */
+    uint8_t                  encoding;                /**< encoding of the image data, see @ref EPD_IMAGE_ENCODING */
+    uint16_t                 remaining;               /**< encoded bytes left before the image window is closed */
+    uint8_t                  rle_count;               /**< bytes left in the current PackBits literal or run */
+    bool                     rle_run;                 /**< the current PackBits packet is a run */
+    uint8_t                  flags;                   /**< see @ref EPD_IMAGE_FLAGS */
+    uint8_t                  seq;                     /**< next expected sequence number */
+    bool                     nacked;                  /**< a NACK was sent for the current gap */
+    uint8_t                  status;                  /**< see @ref EPD_IMAGE_STATUS */
+    uint32_t                 crc;                     /**< CRC32 of the data written so far */
+    uint32_t                 crc_expected;            /**< CRC32 announced in the header */
+    uint16_t                 written;                 /**< decoded bytes written to EPD ram */
+    uint16_t                 size;                    /**< decoded bytes the window holds */
+} epd_image_t;
+
+/**< EPD Service status, notified as state(1) error(1) queue(1) received(4) busy_ms(2) temperature(1) waveform(1) */
+typedef struct
+{
+    uint8_t                  state;                   /**< see @ref EPD_STATE */
+    uint8_t                  error;                   /**< last error, see @ref EPD_ERROR */
+    uint32_t                 received;                /**< bytes received on this connection */
+    uint16_t                 busy_ms;                 /**< duration of the last refresh */
+    int8_t                   temperature;             /**< panel temperature at the last refresh, -128 if not read */
+    uint8_t                  waveform;                /**< waveform of the last full refresh, 0xFF if loaded by the host */
+} epd_status_t;
+
+/**< EPD frame transaction state */
+typedef struct
+{
+    bool                     open;                    /**< a frame transaction is in progress */
+    uint32_t                 id;                      /**< host id of the frame */
+    uint32_t                 size;                    /**< decoded size of all planes */
+    uint32_t                 crc_expected;            /**< CRC32 of all planes announced by the host */
+    uint32_t                 offset;                  /**< decoded bytes acknowledged so far */
+    uint32_t                 crc;                     /**< CRC32 of the acknowledged bytes */
+    bool                     committed;               /**< the refresh in progress was started by a commit */
+} epd_frame_t;
+
 /**@brief EPD Service structure.
  *
  * @details This structure contains status information related to the service.
@@ -72,10 +207,29 @@ typedef struct
     uint16_t                 service_handle;          /**< Handle of EPD Service (as provided by the S110 SoftDevice). */
     ble_gatts_char_handles_t char_handles;            /**< Handles related to the EPD characteristic (as provided by the S110 SoftDevice). */
     uint16_t                 conn_handle;             /**< Handle of the current connection (as provided by the S110 SoftDevice). BLE_CONN_HANDLE_INVALID if not in a connection. */
+    ble_gap_conn_params_t    conn_params;             /**< Parameters of the current connection. */
     bool                     is_notification_enabled; /**< Variable to indicate if the peer has enabled notification of the RX characteristic.*/
     epd_driver_t             *driver;                 /**< current EPD driver */
     epd_config_t             config;                  /**< EPD config */
     epd_callback_t           epd_cmd_cb;              /**< EPD callback */
+    epd_image_t              image;                   /**< current image window */
+    uint32_t                 frame_id;                /**< host token of the frame in EPD ram, 0 if unknown */
+    epd_frame_t              frame;                   /**< current frame transaction */
+    epd_status_t             status;                  /**< status reported to the peer */
+    uint32_t                 refresh_ticks;           /**< RTC1 counter at the start of the refresh */
+    volatile bool            refresh_done;            /**< BUSY was released, the refresh is waiting to be finished */
+    uint8_t                  partial_count;           /**< partial refreshes since the last full refresh */
+    bool                     lut_custom;              /**< the host wrote the panel setting or LUT registers since INIT */
+    uint32_t                 refresh_fingerprint;     /**< fingerprint of the frame being refreshed */
+    uint8_t                  shadow[BLE_EPD_SHADOW_SIZE]; /**< controller registers written by the host: cmd(1) len(1) data(len) ... */
+    uint16_t                 shadow_len;              /**< bytes used in shadow */
+    uint16_t                 shadow_open;             /**< offset of the register taking SEND_DATA, BLE_EPD_SHADOW_SIZE if none */
+    epd_packet_t             rx_queue[BLE_EPD_RX_QUEUE_SIZE]; /**< received packets waiting to be processed */
+    volatile uint8_t         rx_head;                 /**< packets queued, only written by the BLE event handler */
+    volatile uint8_t         rx_tail;                 /**< packets processed, only written by the scheduler */
+    uint8_t                  rx_credits;              /**< credits freed but not granted to the peer yet */
+    volatile bool            rx_scheduled;            /**< queue processing is scheduled */
+    uint16_t                 rx_dropped;              /**< packets dropped on this connection */
 } ble_epd_t;
 
 /**@brief Function for preparing sleep mode.
@@ -84,6 +238,41 @@ typedef struct
  */
 void ble_epd_sleep_prepare(ble_epd_t * p_epd);
 
+/**@brief Function for checking if data is still being received or processed.
+ *
+ * @param[in] p_epd       EPD Service structure.
+ *
+ * @return true if packets are queued or an image window is open.
+ */
+bool ble_epd_is_busy(ble_epd_t * p_epd);
+
+/**@brief Function for finishing a refresh in progress.
+ *
+ * @details Sleeps until the panel releases BUSY, so that the driver can be used or
+ *          shut down afterwards. Returns right away if no refresh is in progress,
+ *          gives up with @ref EPD_ERROR_REFRESH_TIMEOUT after @ref EPD_BUSY_TIMEOUT.
+ *
+ * @param[in] p_epd       EPD Service structure.
+ */
+void ble_epd_refresh_wait(ble_epd_t * p_epd);
+
+/**@brief Function for dropping the frame token when EPD ram is overwritten outside the service.
+ *
+ * @details The host is notified, so it sends the next frame in full.
+ *
+ * @param[in] p_epd       EPD Service structure.
+ */
+void ble_epd_frame_reset(ble_epd_t * p_epd);
+
+/**@brief Function for showing a frame written to EPD ram outside of the service.
+ *
+ * @details Full refresh with the configured waveform, skipped if the frame is already
+ *          on screen. Returns when the panel is done.
+ *
+ * @param[in] p_epd       EPD Service structure.
+ */
+void ble_epd_display(ble_epd_t * p_epd);
+
 /**@brief Function for initializing the EPD Service.
  *
  * @param[out] p_epd      EPD Service structure. This structure must be supplied
@@ -12,7 +12,14 @@
 *
 ******************************************************************************/
 
+#include <string.h>
+#ifndef EPD_SIMULATOR
 #include "nrf_drv_spi.h"
+#include "nrf_drv_gpiote.h"
+#include "nrf_soc.h"
+#include "app_util_platform.h"
+#include "app_timer.h"
+#endif // the simulator declares this subset of the SDK in EPD_sim.h
 #include "EPD_driver.h"
 
 uint32_t EPD_MOSI_PIN = 5;
@@ -23,12 +30,10 @@ uint32_t EPD_RST_PIN = 11;
 uint32_t EPD_BUSY_PIN = 12;
 uint32_t EPD_BS_PIN = 13;
 
-static const nrf_drv_spi_t spi = NRF_DRV_SPI_INSTANCE(0);
-
+/** EPD drivers, a new controller only needs its driver added here */
 extern epd_driver_t epd_driver_4in2;
 extern epd_driver_t epd_driver_4in2bv2;
 
-/** EPD drivers */
 static epd_driver_t *epd_drivers[] = {
     &epd_driver_4in2,
     &epd_driver_4in2bv2,
@@ -56,6 +61,12 @@ epd_driver_t *epd_driver_by_id(uint8_t id)
     return NULL;
 }
 
+/**< drivers in registration order, NULL past the last one */
+epd_driver_t *epd_driver_at(uint8_t index)
+{
+    return index < ARRAY_SIZE(epd_drivers) ? epd_drivers[index] : NULL;
+}
+
 bool epd_driver_set(uint8_t id)
 {
     epd_driver_t *driver = epd_driver_by_id(id);
@@ -67,6 +78,50 @@ bool epd_driver_set(uint8_t id)
     return false;
 }
 
+static const nrf_drv_spi_t spi = NRF_DRV_SPI_INSTANCE(0);
+
+/**< SPI transmit buffers, one is filled while the other one is clocked out */
+#define SPI_BUFFER_SIZE 64
+static UBYTE m_spi_buffer[2][SPI_BUFFER_SIZE];
+static UBYTE m_spi_buffer_idx = 0;
+static volatile bool m_spi_busy = false;
+static bool m_data_open = false;                      /**< CS low with DC high, more data may follow */
+
+static epd_busy_callback_t m_busy_callback = NULL;
+static void * m_busy_context = NULL;
+static volatile bool m_busy_wait = false;
+
+static void spi_event_handler(nrf_drv_spi_evt_t const * p_event)
+{
+    m_spi_busy = false;
+}
+
+static void busy_evt_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+{
+    nrf_drv_gpiote_in_event_disable(pin);
+    if (!m_busy_wait) return;
+
+    m_busy_wait = false;
+    if (m_busy_callback != NULL)
+        m_busy_callback(m_busy_context);
+}
+
+static void DEV_SPI_Init(void)
+{
+    nrf_drv_spi_config_t spi_config =
+    {
+        .sck_pin      = EPD_SCLK_PIN,
+        .mosi_pin     = EPD_MOSI_PIN,
+        .miso_pin     = NRF_DRV_SPI_PIN_NOT_USED,
+        .ss_pin       = NRF_DRV_SPI_PIN_NOT_USED,
+        .irq_priority = APP_IRQ_PRIORITY_LOW,
+        .frequency    = NRF_DRV_SPI_FREQ_4M,
+        .mode         = NRF_DRV_SPI_MODE_0,
+    };
+    m_spi_busy = false;
+    nrf_drv_spi_init(&spi, &spi_config, spi_event_handler);
+}
+
 /******************************************************************************
 function: Initialize Arduino, Initialize Pins, and SPI
 parameter:
@@ -74,24 +129,23 @@ Info:
 ******************************************************************************/
 UBYTE DEV_Module_Init(void)
 {
+    EPD_SetAwake(false);                              // RST is low until the driver resets the controller
     nrf_gpio_cfg_output(EPD_CS_PIN);
     nrf_gpio_cfg_output(EPD_DC_PIN);
     nrf_gpio_cfg_output(EPD_RST_PIN);
-    nrf_gpio_cfg_input(EPD_BUSY_PIN, NRF_GPIO_PIN_NOPULL);
+
+    // BUSY is low while the controller is busy, the release is sensed as a low power PORT event
+    if (!nrf_drv_gpiote_is_init())
+        nrf_drv_gpiote_init();
+    nrf_drv_gpiote_in_config_t busy_config = GPIOTE_CONFIG_IN_SENSE_LOTOHI(false);
+    m_busy_wait = false;
+    nrf_drv_gpiote_in_init(EPD_BUSY_PIN, &busy_config, busy_evt_handler);
   
     nrf_gpio_cfg_output(EPD_BS_PIN);
     DEV_Digital_Write(EPD_BS_PIN, 0);
 
-    nrf_drv_spi_config_t spi_config =
-    {
-        .sck_pin      = EPD_SCLK_PIN,
-        .mosi_pin     = EPD_MOSI_PIN,
-        .miso_pin     = NRF_DRV_SPI_PIN_NOT_USED,
-        .ss_pin       = NRF_DRV_SPI_PIN_NOT_USED,
-        .frequency    = NRF_DRV_SPI_FREQ_4M,
-        .mode         = NRF_DRV_SPI_MODE_0,
-    };
-    nrf_drv_spi_init(&spi, &spi_config, NULL);
+    m_data_open = false;
+    DEV_SPI_Init();
 
     DEV_Digital_Write(EPD_DC_PIN, 0);
     DEV_Digital_Write(EPD_CS_PIN, 0);
@@ -102,40 +156,182 @@ UBYTE DEV_Module_Init(void)
 
 void DEV_Module_Exit(void)
 {
+    DEV_SPI_Flush();
+    m_data_open = false;
+
     DEV_Digital_Write(EPD_DC_PIN, 0);
     DEV_Digital_Write(EPD_CS_PIN, 0);
 
     //close 5V
     DEV_Digital_Write(EPD_RST_PIN, 0);
+    EPD_SetAwake(false);
+
+    nrf_drv_gpiote_in_event_disable(EPD_BUSY_PIN);
+    m_busy_wait = false;
+    nrf_drv_gpiote_in_uninit(EPD_BUSY_PIN);
 
     nrf_drv_spi_uninit(&spi);
 }
 
+/******************************************************************************
+function: Wait for the BUSY pin to be released
+parameter:
+    callback : called from the GPIOTE interrupt once the controller is idle,
+               right away if it is idle already
+******************************************************************************/
+void DEV_Wait_Busy(epd_busy_callback_t callback, void * p_context)
+{
+    m_busy_callback = callback;
+    m_busy_context = p_context;
+    m_busy_wait = true;
+    nrf_drv_gpiote_in_event_enable(EPD_BUSY_PIN, true);
+}
+
+/******************************************************************************
+function: Wait for the BUSY pin to be released, the CPU sleeps meanwhile
+parameter:
+return: false if BUSY is still low after EPD_BUSY_TIMEOUT
+******************************************************************************/
+bool DEV_Wait_Busy_Sleep(void)
+{
+    uint32_t start = app_timer_cnt_get();
+    uint32_t ticks = 0;
+
+    DEV_Wait_Busy(NULL, NULL);
+    while (m_busy_wait && ticks < EPD_BUSY_TIMEOUT)
+    {
+        sd_app_evt_wait();
+        app_timer_cnt_diff_compute(app_timer_cnt_get(), start, &ticks);
+    }
+    if (!m_busy_wait) return true;
+
+    nrf_drv_gpiote_in_event_disable(EPD_BUSY_PIN);
+    m_busy_wait = false;
+    return false;
+}
+
 /*********************************************
 function: Hardware interface
 note:
   SPI4W_Write_Byte(value) : 
     Register hardware SPI
+  Transfers are interrupt driven: DEV_SPI_WriteBytes copies
+  into one buffer while the other one is clocked out and
+  returns before the last chunk is done, DEV_SPI_Flush waits
+  for it.
 *********************************************/  
+void DEV_SPI_Flush(void)
+{
+    while (m_spi_busy)
+        DEV_SPI_Idle();
+}
+
+static void DEV_SPI_Start(UBYTE *value, UBYTE len)
+{
+    DEV_SPI_Flush();
+    m_spi_busy = true;
+    if (nrf_drv_spi_transfer(&spi, value, len, NULL, 0) != NRF_SUCCESS)
+        m_spi_busy = false;
+}
+
 void DEV_SPI_WriteByte(UBYTE value)
 {
-    nrf_drv_spi_transfer(&spi, &value, 1, NULL, 0);
+    DEV_SPI_WriteBytes(&value, 1);
+    DEV_SPI_Flush();
+}
+
+void DEV_SPI_WriteBytes(UBYTE *value, UWORD len)
+{
+    while (len > 0)
+    {
+        UBYTE n = len > SPI_BUFFER_SIZE ? SPI_BUFFER_SIZE : len;
+        UBYTE *buffer = m_spi_buffer[m_spi_buffer_idx];
+
+        memcpy(buffer, value, n);
+        DEV_SPI_Start(buffer, n);
+        m_spi_buffer_idx ^= 1;
+
+        value += n;
+        len -= n;
+    }
 }
 
-void DEV_SPI_WriteBytes(UBYTE *value, UBYTE len)
+void DEV_SPI_FillBytes(UBYTE value, UWORD len)
 {
-    nrf_drv_spi_transfer(&spi, value, len, NULL, 0);
+    while (len > 0)
+    {
+        UBYTE n = len > SPI_BUFFER_SIZE ? SPI_BUFFER_SIZE : len;
+        UBYTE *buffer = m_spi_buffer[m_spi_buffer_idx];
+
+        memset(buffer, value, n);
+        DEV_SPI_Start(buffer, n);
+        m_spi_buffer_idx ^= 1;
+
+        len -= n;
+    }
 }
 
 UBYTE DEV_SPI_ReadByte(void)
 {
     UBYTE value;
-    nrf_drv_spi_transfer(&spi, NULL, 0, &value, 1);
+    DEV_SPI_Flush();
+    m_spi_busy = true;
+    if (nrf_drv_spi_transfer(&spi, NULL, 0, &value, 1) != NRF_SUCCESS)
+        m_spi_busy = false;
+    DEV_SPI_Flush();
     return value;
 }
 
+/**
+ * DC and CS can only change once the SPI is idle, an open data
+ * transfer is closed by the next command or byte.
+**/
+static void EPD_WriteClose(void)
+{
+    DEV_SPI_Flush();
+    if (m_data_open)
+    {
+        DEV_Digital_Write(EPD_CS_PIN, 1);
+        m_data_open = false;
+    }
+}
+
+/**
+ * The panel has a 3-wire interface, SDA is driven by the controller
+ * while reading, so the bits are clocked in by hand on the MOSI pin.
+**/
+void EPD_ReadData(UBYTE *Data, UBYTE Len)
+{
+    EPD_WriteClose();
+    nrf_drv_spi_uninit(&spi);
+
+    nrf_gpio_cfg_input(EPD_MOSI_PIN, NRF_GPIO_PIN_NOPULL);
+    nrf_gpio_cfg_output(EPD_SCLK_PIN);
+    DEV_Digital_Write(EPD_SCLK_PIN, 0);
+    DEV_Digital_Write(EPD_DC_PIN, 1);
+    DEV_Digital_Write(EPD_CS_PIN, 0);
+    for (UBYTE i = 0; i < Len; i++)
+    {
+        UBYTE value = 0;
+        for (UBYTE bit = 0; bit < 8; bit++)
+        {
+            DEV_Digital_Write(EPD_SCLK_PIN, 1);
+            DEV_Delay_us(1);
+            value = (value << 1) | DEV_Digital_Read(EPD_MOSI_PIN);
+            DEV_Digital_Write(EPD_SCLK_PIN, 0);
+            DEV_Delay_us(1);
+        }
+        Data[i] = value;
+    }
+    DEV_Digital_Write(EPD_CS_PIN, 1);
+
+    DEV_SPI_Init();
+}
+
 void EPD_WriteCommand(UBYTE Reg)
 {
+    EPD_RamHashCommand(Reg);
+    EPD_WriteClose();
     DEV_Digital_Write(EPD_DC_PIN, 0);
     DEV_Digital_Write(EPD_CS_PIN, 0);
     DEV_SPI_WriteByte(Reg);
@@ -144,16 +340,129 @@ void EPD_WriteCommand(UBYTE Reg)
 
 void EPD_WriteByte(UBYTE Data)
 {
+    EPD_RamHashData(&Data, 1);
+    EPD_WriteClose();
     DEV_Digital_Write(EPD_DC_PIN, 1);
     DEV_Digital_Write(EPD_CS_PIN, 0);
     DEV_SPI_WriteByte(Data);
     DEV_Digital_Write(EPD_CS_PIN, 1);
 }
 
-void EPD_WriteData(UBYTE *Data, UBYTE Len)
+static void EPD_WriteOpen(void)
 {
-    DEV_Digital_Write(EPD_DC_PIN, 1);
-    DEV_Digital_Write(EPD_CS_PIN, 0);
+    if (!m_data_open)
+    {
+        DEV_SPI_Flush();
+        DEV_Digital_Write(EPD_DC_PIN, 1);
+        DEV_Digital_Write(EPD_CS_PIN, 0);
+        m_data_open = true;
+    }
+}
+
+void EPD_WriteData(UBYTE *Data, UWORD Len)
+{
+    EPD_RamHashData(Data, Len);
+    EPD_WriteOpen();
     DEV_SPI_WriteBytes(Data, Len);
-    DEV_Digital_Write(EPD_CS_PIN, 1);
+}
+
+void EPD_FillData(UBYTE Value, UWORD Count)
+{
+    EPD_RamHashFill(Value, Count);
+    EPD_WriteOpen();
+    DEV_SPI_FillBytes(Value, Count);
+}
+
+/**
+ * Write a whole RAM plane (or partial window) in one burst,
+ * CS stays asserted until the next command.
+**/
+void EPD_WritePlane(UBYTE Reg, UBYTE *Data, UWORD Len)
+{
+    EPD_WriteCommand(Reg);
+    EPD_WriteData(Data, Len);
+}
+
+void EPD_FillPlane(UBYTE Reg, UBYTE Value, UWORD Count)
+{
+    EPD_WriteCommand(Reg);
+    EPD_FillData(Value, Count);
+}
+
+/**< registers survive until the next reset or deep sleep */
+static bool m_awake = false;
+
+bool EPD_IsAwake(void)
+{
+    return m_awake;
+}
+
+void EPD_SetAwake(bool awake)
+{
+    m_awake = awake;
+}
+
+/**
+ * FNV-1a hash of everything written to the controller since the last
+ * EPD_RamHashReset(), two identical streams leave identical RAM behind.
+ * Commands are hashed as 9 bit symbols so they can not alias data.
+**/
+#define EPD_HASH_BASIS 2166136261UL
+#define EPD_HASH_PRIME 16777619UL
+
+static uint32_t m_ram_hash = EPD_HASH_BASIS;
+static UWORD m_ram_rows[2];                         // rows of DTM1 (0x10) and DTM2 (0x13) the hash covers
+
+void EPD_RamHashReset(void)
+{
+    m_ram_hash = EPD_HASH_BASIS;
+    EPD_RamHashLost();
+}
+
+/**
+ * Full width rows y to y+h-1 of a plane were written. They only count in
+ * order from the top, so the hash stands for the whole plane once
+ * EPD_RamHashRows() reaches its height.
+**/
+void EPD_RamHashWindow(UBYTE Plane, UWORD y, UWORD h)
+{
+    UWORD *rows = &m_ram_rows[Plane == 0x10 ? 0 : 1];
+    if (y <= *rows && y + h > *rows)
+        *rows = y + h;
+}
+
+UWORD EPD_RamHashRows(UBYTE Plane)
+{
+    return m_ram_rows[Plane == 0x10 ? 0 : 1];
+}
+
+void EPD_RamHashLost(void)
+{
+    m_ram_rows[0] = m_ram_rows[1] = 0;
+}
+
+uint32_t EPD_RamHash(void)
+{
+    return m_ram_hash;
+}
+
+void EPD_RamHashCommand(UBYTE Reg)
+{
+    m_ram_hash = (m_ram_hash ^ (0x100 | Reg)) * EPD_HASH_PRIME;
+}
+
+void EPD_RamHashData(UBYTE *Data, UWORD Len)
+{
+    uint32_t hash = m_ram_hash;
+    while (Len--)
+        hash = (hash ^ *Data++) * EPD_HASH_PRIME;
+    m_ram_hash = hash;
+}
+
+void EPD_RamHashFill(UBYTE Value, UWORD Count)
+{
+    uint32_t hash = m_ram_hash;
+    while (Count--)
+        hash = (hash ^ Value) * EPD_HASH_PRIME;
+    m_ram_hash = hash;
 }
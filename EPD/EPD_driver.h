@@ -17,8 +17,12 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#ifdef EPD_SIMULATOR
+#include "EPD_sim.h"                                  // stands in for the SDK headers on the host
+#else
 #include "nrf_delay.h"
 #include "nrf_gpio.h"
+#endif
 
 #ifndef ARRAY_SIZE
 #define ARRAY_SIZE(arr)                    (sizeof(arr) / sizeof((arr)[0]))
@@ -38,6 +42,42 @@ enum EPD_DRIVER_IDS
     EPD_DRIVER_4IN2B_V2 = 3,
 };
 
+/**< EPD driver capability flags */
+enum EPD_CAPS_FLAGS
+{
+    EPD_CAPS_PARTIAL = 0x01,                          /**< refresh_partial is supported */
+    EPD_CAPS_TEMPERATURE = 0x02,                      /**< read_temperature is supported */
+    EPD_CAPS_WAVEFORM = 0x04,                         /**< set_waveform is supported */
+};
+
+/**@brief EPD driver capabilities.
+ *
+ * @details Lets the GUI and BLE layers pick a rendering path without knowing the panel.
+ */
+typedef struct
+{
+    uint8_t planes;                                   /**< RAM planes written per image, 1: black/white, 2: black/white/colour */
+    uint8_t grey_levels;                              /**< grey levels reachable with register LUTs, 2 if none */
+    uint8_t lut_slots;                                /**< LUT registers of the controller, 0 if OTP only */
+    uint8_t black_cmd;                                /**< data transmission command of the black plane */
+    uint8_t color_cmd;                                /**< data transmission command of the colour plane, 0 if none */
+    uint8_t flags;                                    /**< see @ref EPD_CAPS_FLAGS */
+} epd_caps_t;
+
+/**< Full refresh waveforms, 0 is the OTP LUT of the panel, unknown ones fall back to it */
+#define EPD_WAVEFORM_OTP                   0x00
+#define EPD_WAVEFORM_AUTO                  0xFD       /**< picked by temperature */
+#define EPD_WAVEFORM_GREY                  0xFE       /**< 4 grey levels, see @ref epd_caps_t grey_levels */
+#define EPD_WAVEFORM_HOST                  0xFF       /**< LUT registers written by the host */
+#define EPD_TEMPERATURE_UNKNOWN            INT8_MIN
+
+/**< Longest BUSY wait in RTC1 ticks (32768 Hz), the three colour panel takes
+ *   about 15 s in the cold, a controller still busy after this is stuck */
+#define EPD_BUSY_TIMEOUT                   (30 * 32768)
+
+/**< Called once the BUSY pin is released, from the GPIOTE interrupt */
+typedef void (*epd_busy_callback_t)(void * p_context);
+
 /**@brief EPD driver structure.
  *
  * @details This structure contains epd driver functions.
@@ -47,13 +87,23 @@ typedef struct
     uint8_t id;                                       /**< driver ID. */
 	uint16_t width;
 	uint16_t height;
+    epd_caps_t caps;                                  /**< what the panel and controller support */
     void (*init)(void);                               /**< Initialize the e-Paper register */
     void (*clear)(void);                              /**< Clear screen */
     void (*send_command)(UBYTE Reg);                  /**< send command */
 	void (*send_byte)(UBYTE Reg);                     /**< send byte */
-    void (*send_data)(UBYTE *Data, UBYTE Len);        /**< send data */
+    void (*send_data)(UBYTE *Data, UWORD Len);        /**< send data */
+    void (*write_plane)(UBYTE Reg, UBYTE *Data, UWORD Len);     /**< send command followed by a data burst */
+    void (*fill_plane)(UBYTE Reg, UBYTE Value, UWORD Count);    /**< send command followed by Count bytes of Value */
     void (*write_image)(UBYTE *black, UBYTE *color, UWORD x, UWORD y, UWORD w, UWORD h); /**< write image */
+    bool (*write_image_begin)(UBYTE plane, UWORD x, UWORD y, UWORD w, UWORD h); /**< open a partial window, data goes to send_data */
+    void (*write_image_end)(void);                    /**< close the partial window */
     void (*refresh)(void);                            /**< Sends the image buffer in RAM to e-Paper and displays */
+    void (*refresh_start)(epd_busy_callback_t callback, void * p_context); /**< start the refresh, callback runs when done */
+    void (*refresh_end)(void);                        /**< finish the refresh after the callback ran */
+    void (*refresh_partial)(UWORD x, UWORD y, UWORD w, UWORD h); /**< fast refresh of a window, NULL if not supported */
+    bool (*read_temperature)(int8_t *temperature);  /**< read the temperature sensor in degrees C, NULL if not supported */
+    UBYTE (*set_waveform)(UBYTE waveform, int8_t temperature); /**< load a full refresh waveform, returns the one loaded, NULL if OTP only */
     void (*sleep)(void);                              /**< Enter sleep mode */
 } epd_driver_t;
 
@@ -77,18 +127,53 @@ extern uint32_t EPD_BS_PIN;
 #define DEV_Delay_ms(__xms) nrf_delay_ms(__xms);
 #define DEV_Delay_us(__xus) nrf_delay_us(__xus);
 
+/**
+ * spin while a SPI transfer is in flight, the simulator has
+ * no interrupts and completes the transfer here instead
+**/
+#ifdef EPD_SIMULATOR
+#define DEV_SPI_Idle() epd_sim_spi_irq()
+#else
+#define DEV_SPI_Idle()
+#endif
+
 UBYTE DEV_Module_Init(void);
 void DEV_Module_Exit(void);
 
+void DEV_Wait_Busy(epd_busy_callback_t callback, void * p_context);
+bool DEV_Wait_Busy_Sleep(void);
+
 void DEV_SPI_WriteByte(UBYTE value);
-void DEV_SPI_WriteBytes(UBYTE *value, UBYTE len);
+void DEV_SPI_WriteBytes(UBYTE *value, UWORD len);
+void DEV_SPI_FillBytes(UBYTE value, UWORD len);
+void DEV_SPI_Flush(void);
 
 void EPD_WriteCommand(UBYTE Reg);
 void EPD_WriteByte(UBYTE Data);
-void EPD_WriteData(UBYTE *Data, UBYTE Len);
+void EPD_WriteData(UBYTE *Data, UWORD Len);
+void EPD_FillData(UBYTE Value, UWORD Count);
+void EPD_ReadData(UBYTE *Data, UBYTE Len);
+void EPD_WritePlane(UBYTE Reg, UBYTE *Data, UWORD Len);
+void EPD_FillPlane(UBYTE Reg, UBYTE Value, UWORD Count);
+
+// The controller was initialized and has not been put to sleep or held in reset since
+bool EPD_IsAwake(void);
+void EPD_SetAwake(bool awake);
+
+// Hash of the bytes sent to the controller, used to fingerprint frames
+void EPD_RamHashReset(void);
+uint32_t EPD_RamHash(void);
+void EPD_RamHashCommand(UBYTE Reg);
+void EPD_RamHashData(UBYTE *Data, UWORD Len);
+void EPD_RamHashFill(UBYTE Value, UWORD Count);
+// Rows of a plane (0x10 or 0x13) the hash covers, nothing after a reset or data of unknown destination
+void EPD_RamHashWindow(UBYTE Plane, UWORD y, UWORD h);
+UWORD EPD_RamHashRows(UBYTE Plane);
+void EPD_RamHashLost(void);
 
 epd_driver_t *epd_driver_get(void);
 epd_driver_t *epd_driver_by_id(uint8_t id);
+epd_driver_t *epd_driver_at(uint8_t index);
 bool epd_driver_set(uint8_t id);
 
 #endif
@@ -0,0 +1,472 @@
+/*****************************************************************************
+* | File        : EPD_sim.c
+* | Function    : UC8176 simulator for host builds
+* | Info        :
+*   Implements the SDK calls of EPD_driver.c when built with
+*   -DEPD_SIMULATOR, so the real SPI/CS/DC code of the driver runs on the
+*   host. Bytes are decoded when their SPI transfer completes, with the
+*   CS/DC levels of that moment, into a model of the controller: panel
+*   setting, PLL, LUT registers, DTM1/DTM2 ram, the partial window
+*   (0x90-0x92), refresh, deep sleep and the temperature read (0x40).
+*
+******************************************************************************/
+
+#ifdef EPD_SIMULATOR
+
+#include <stdio.h>
+#include <string.h>
+#include "EPD_driver.h"
+
+#define SIM_WIDTH       400
+#define SIM_HEIGHT      300
+#define SIM_STRIDE      (SIM_WIDTH / 8)
+#define SIM_LUT_SIZE    44
+#define SIM_SPI_MAX     255
+
+/**< OTP waveform durations, as measured on the supported panels */
+#define SIM_OTP_KW_MS   3000
+#define SIM_OTP_KWR_MS  15000
+
+typedef struct
+{
+    UBYTE ram[2][SIM_STRIDE * SIM_HEIGHT];            /**< DTM1 (0x10) and DTM2 (0x13) */
+    UBYTE lut[6][SIM_LUT_SIZE];                       /**< LUT registers 0x20-0x25 */
+    UBYTE panel;                                      /**< panel setting (0x00) */
+    UBYTE pll;                                        /**< PLL control (0x30) */
+    UBYTE window[9];                                  /**< partial window (0x90) parameters */
+    UWORD xs, xe, ys, ye;                             /**< partial window, byte columns and rows, inclusive */
+    bool partial;                                     /**< partial in (0x91) */
+    bool sleeping;                                    /**< deep sleep (0x07 0xA5), left by a reset only */
+    UBYTE cmd;                                        /**< last command */
+    UDOUBLE index;                                    /**< data bytes since the last command */
+    UDOUBLE read_bits;                                /**< bits clocked in by hand since the last command */
+    bool dc;
+    bool cs;                                          /**< selected, the pin is low */
+    bool sclk;
+    int8_t temperature;
+} epd_sim_t;
+
+/**< SPI master and the GPIOTE channel of BUSY */
+typedef struct
+{
+    bool ready;                                       /**< between nrf_drv_spi_init and nrf_drv_spi_uninit */
+    nrf_drv_spi_handler_t handler;
+    uint8_t const *tx;                                /**< transfer in flight, NULL if none */
+    UBYTE tx_copy[SIM_SPI_MAX];                       /**< what tx held when the transfer started */
+    UBYTE tx_len;
+    UBYTE *rx;
+    UBYTE rx_len;
+    nrf_drv_gpiote_evt_handler_t busy_handler;
+    bool busy_enabled;
+    bool busy_held;                                   /**< see epd_sim_hold_busy() */
+} epd_sim_bus_t;
+
+static epd_sim_t m_sim;
+static epd_sim_bus_t m_bus;
+static epd_sim_stats_t m_stats;
+static uint32_t m_ticks;                              /**< RTC1 counter of app_timer */
+static const char *m_snapshot_prefix = NULL;
+
+static void epd_sim_reset(void)
+{
+    memset(m_sim.ram, 0, sizeof(m_sim.ram));
+    memset(m_sim.lut, 0, sizeof(m_sim.lut));
+    m_sim.panel = 0x0f;
+    m_sim.pll = 0x3c;
+    m_sim.partial = false;
+    m_sim.sleeping = false;
+    m_sim.cmd = 0;
+    m_sim.index = 0;
+    m_sim.read_bits = 0;
+    m_stats.resets++;
+}
+
+/**< frames of a LUT: 7 groups of level(1) frames(4) repeat(1) */
+static UDOUBLE epd_sim_lut_frames(const UBYTE *lut)
+{
+    UDOUBLE frames = 0;
+    for (UBYTE i = 0; i < 7; i++)
+    {
+        const UBYTE *group = &lut[i * 6];
+        frames += (group[1] + group[2] + group[3] + group[4]) * group[5];
+    }
+    return frames;
+}
+
+static UDOUBLE epd_sim_frame_rate(void)
+{
+    switch (m_sim.pll)
+    {
+        case 0x3a: return 100;
+        case 0x31: return 171;
+        case 0x29: return 150;
+        case 0x39: return 200;
+        default:   return 50;
+    }
+}
+
+static void epd_sim_write_snapshot(void)
+{
+    char name[256];
+    bool kw = m_sim.panel & 0x10;                     // KW mode, no red plane
+    const UBYTE *black = kw ? m_sim.ram[1] : m_sim.ram[0];
+    const UBYTE *red = m_sim.ram[1];
+
+    if (m_snapshot_prefix == NULL) return;
+
+    snprintf(name, sizeof(name), "%s%04u.%s", m_snapshot_prefix,
+             (unsigned)(m_stats.refreshes + m_stats.partial_refreshes), kw ? "pbm" : "ppm");
+    FILE *fp = fopen(name, "wb");
+    if (fp == NULL) return;
+
+    if (kw)
+    {
+        fprintf(fp, "P4\n%d %d\n", SIM_WIDTH, SIM_HEIGHT);
+        for (UDOUBLE i = 0; i < sizeof(m_sim.ram[1]); i++)
+            fputc((UBYTE)~black[i], fp);              // ram: 1 is white, PBM: 1 is black
+    }
+    else
+    {
+        fprintf(fp, "P6\n%d %d\n255\n", SIM_WIDTH, SIM_HEIGHT);
+        for (UDOUBLE i = 0; i < sizeof(m_sim.ram[0]) * 8; i++)
+        {
+            static const UBYTE rgb[3][3] = {{0xff, 0xff, 0xff}, {0x00, 0x00, 0x00}, {0xff, 0x00, 0x00}};
+            UBYTE mask = 0x80 >> (i % 8);
+            if (!(red[i / 8] & mask))
+                fwrite(rgb[2], 1, 3, fp);
+            else if (!(black[i / 8] & mask))
+                fwrite(rgb[1], 1, 3, fp);
+            else
+                fwrite(rgb[0], 1, 3, fp);
+        }
+    }
+    fclose(fp);
+}
+
+static void epd_sim_refresh(void)
+{
+    UDOUBLE ms;
+
+    if (m_sim.panel & 0x20)                           // LUT from register
+        ms = epd_sim_lut_frames(m_sim.lut[0]) * 1000 / epd_sim_frame_rate();
+    else
+        ms = (m_sim.panel & 0x10) ? SIM_OTP_KW_MS : SIM_OTP_KWR_MS;
+
+    if (m_sim.partial)
+        m_stats.partial_refreshes++;
+    else
+        m_stats.refreshes++;
+    m_stats.refresh_ms += ms;
+
+    epd_sim_write_snapshot();
+}
+
+static void epd_sim_window_set(void)
+{
+    m_sim.xs = ((m_sim.window[0] << 8) | m_sim.window[1]) / 8;
+    m_sim.xe = ((m_sim.window[2] << 8) | m_sim.window[3]) / 8;
+    m_sim.ys = (m_sim.window[4] << 8) | m_sim.window[5];
+    m_sim.ye = (m_sim.window[6] << 8) | m_sim.window[7];
+    if (m_sim.xe >= SIM_STRIDE) m_sim.xe = SIM_STRIDE - 1;
+    if (m_sim.ye >= SIM_HEIGHT) m_sim.ye = SIM_HEIGHT - 1;
+}
+
+static void epd_sim_ram_write(UBYTE plane, UBYTE value)
+{
+    UWORD xs = 0, xe = SIM_STRIDE - 1, ys = 0, ye = SIM_HEIGHT - 1;
+    if (m_sim.partial)
+    {
+        xs = m_sim.xs; xe = m_sim.xe; ys = m_sim.ys; ye = m_sim.ye;
+    }
+    if (xe < xs || ye < ys) return;
+
+    UWORD wb = xe - xs + 1;
+    UDOUBLE row = ys + m_sim.index / wb;
+    UDOUBLE col = xs + m_sim.index % wb;
+    if (row <= ye)
+        m_sim.ram[plane][row * SIM_STRIDE + col] = value;
+}
+
+static void epd_sim_command(UBYTE cmd)
+{
+    m_stats.commands++;
+    if (m_sim.sleeping) return;
+
+    m_sim.cmd = cmd;
+    m_sim.index = 0;
+    m_sim.read_bits = 0;
+    switch (cmd)
+    {
+        case 0x12: epd_sim_refresh(); break;
+        case 0x91: m_sim.partial = true; break;
+        case 0x92: m_sim.partial = false; break;
+        default: break;
+    }
+}
+
+static void epd_sim_data(UBYTE value)
+{
+    m_stats.bytes++;
+    if (m_sim.sleeping) return;
+
+    switch (m_sim.cmd)
+    {
+        case 0x00:
+            if (m_sim.index == 0) m_sim.panel = value;
+            break;
+        case 0x07:
+            if (value == 0xa5) m_sim.sleeping = true;
+            break;
+        case 0x10:
+        case 0x13:
+            epd_sim_ram_write(m_sim.cmd == 0x10 ? 0 : 1, value);
+            break;
+        case 0x20: case 0x21: case 0x22: case 0x23: case 0x24: case 0x25:
+            if (m_sim.index < SIM_LUT_SIZE) m_sim.lut[m_sim.cmd - 0x20][m_sim.index] = value;
+            break;
+        case 0x30:
+            m_sim.pll = value;
+            break;
+        case 0x90:
+            if (m_sim.index < sizeof(m_sim.window)) m_sim.window[m_sim.index] = value;
+            if (m_sim.index == 7) epd_sim_window_set();
+            break;
+        default:
+            break;
+    }
+    m_sim.index++;
+}
+
+/**< a byte clocked out while CS is low, DC tells command from data */
+static void epd_sim_clock(UBYTE value)
+{
+    if (!m_sim.cs) return;
+    if (m_sim.dc)
+        epd_sim_data(value);
+    else
+        epd_sim_command(value);
+}
+
+/**< level the controller drives on SDA for a bit read by hand, MSB first */
+static uint32_t epd_sim_read_bit(UDOUBLE bit)
+{
+    UBYTE byte = 0xff;                                // nothing drives SDA
+
+    if (m_sim.sleeping) return 1;
+    if (m_sim.cmd == 0x40)                            // temperature, integer part then fraction
+        byte = bit < 8 ? (UBYTE)m_sim.temperature : 0x00;
+    return (byte >> (7 - bit % 8)) & 1;
+}
+
+/******************************************************************************
+function: GPIO and delays
+******************************************************************************/
+void nrf_gpio_cfg_output(uint32_t pin)
+{
+}
+
+void nrf_gpio_cfg_input(uint32_t pin, uint32_t pull)
+{
+}
+
+void nrf_gpio_pin_write(uint32_t pin, uint32_t value)
+{
+    if ((pin == EPD_DC_PIN || pin == EPD_CS_PIN || pin == EPD_RST_PIN) && m_bus.tx != NULL)
+        m_stats.bus_errors++;                         // would corrupt the bytes still being clocked out
+
+    if (pin == EPD_RST_PIN && value == 0)
+        epd_sim_reset();
+    else if (pin == EPD_DC_PIN)
+        m_sim.dc = value;
+    else if (pin == EPD_CS_PIN)
+        m_sim.cs = !value;
+    else if (pin == EPD_SCLK_PIN && !m_bus.ready)
+    {
+        bool rising = value && !m_sim.sclk;
+        m_sim.sclk = value;
+        if (rising && m_sim.cs && m_sim.dc)
+        {
+            if (++m_sim.read_bits % 8 == 0)
+                m_stats.bytes++;
+        }
+    }
+}
+
+uint32_t nrf_gpio_pin_read(uint32_t pin)
+{
+    if (pin == EPD_BUSY_PIN)
+        return !m_bus.busy_held;                      // BUSY is released right away
+    if (pin == EPD_MOSI_PIN && !m_bus.ready && m_sim.cs && m_sim.dc && m_sim.read_bits > 0)
+        return epd_sim_read_bit(m_sim.read_bits - 1); // shifted out on the last rising edge
+    return 0;
+}
+
+void nrf_delay_us(uint32_t us)
+{
+    static uint32_t remainder = 0;
+    remainder += us;
+    m_stats.delay_ms += remainder / 1000;
+    remainder %= 1000;
+}
+
+void nrf_delay_ms(uint32_t ms)
+{
+    nrf_delay_us(ms * 1000);
+}
+
+uint32_t sd_app_evt_wait(void)
+{
+    epd_sim_spi_irq();
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_get(void)
+{
+    return m_ticks += 32768 / 10;                     // 100 ms per call
+}
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from, uint32_t * p_ticks_diff)
+{
+    *p_ticks_diff = (ticks_to - ticks_from) & 0x00FFFFFF;
+    return NRF_SUCCESS;
+}
+
+/******************************************************************************
+function: SPI master, transfers stay in flight until epd_sim_spi_irq()
+******************************************************************************/
+uint32_t nrf_drv_spi_init(nrf_drv_spi_t const * const p_instance,
+                          nrf_drv_spi_config_t const * p_config,
+                          nrf_drv_spi_handler_t handler)
+{
+    m_bus.ready = true;
+    m_bus.handler = handler;
+    m_bus.tx = NULL;
+    return NRF_SUCCESS;
+}
+
+void nrf_drv_spi_uninit(nrf_drv_spi_t const * const p_instance)
+{
+    if (m_bus.tx != NULL)
+        m_stats.bus_errors++;                         // the transfer in flight is aborted
+    m_bus.ready = false;
+    m_bus.tx = NULL;
+}
+
+uint32_t nrf_drv_spi_transfer(nrf_drv_spi_t const * const p_instance,
+                              uint8_t const * p_tx_buffer, uint8_t tx_buffer_length,
+                              uint8_t * p_rx_buffer, uint8_t rx_buffer_length)
+{
+    static const UBYTE none = 0;
+
+    if (!m_bus.ready || m_bus.tx != NULL) return NRF_ERROR_BUSY;
+
+    m_bus.tx = p_tx_buffer != NULL ? p_tx_buffer : &none;
+    m_bus.tx_len = p_tx_buffer != NULL ? tx_buffer_length : 0;
+    memcpy(m_bus.tx_copy, m_bus.tx, m_bus.tx_len);
+    m_bus.rx = p_rx_buffer;
+    m_bus.rx_len = rx_buffer_length;
+    m_stats.transfers++;
+
+    if (m_bus.handler == NULL)                        // blocking mode
+        epd_sim_spi_irq();
+    return NRF_SUCCESS;
+}
+
+void epd_sim_spi_irq(void)
+{
+    if (m_bus.tx == NULL) return;
+
+    if (memcmp(m_bus.tx_copy, m_bus.tx, m_bus.tx_len) != 0)
+        m_stats.bus_errors++;                         // the buffer was refilled before it went out
+    for (UBYTE i = 0; i < m_bus.tx_len; i++)
+        epd_sim_clock(m_bus.tx_copy[i]);
+    if (m_bus.rx != NULL)
+        memset(m_bus.rx, 0xff, m_bus.rx_len);         // 3-wire panel, nothing on MISO
+    m_bus.tx = NULL;
+
+    if (m_bus.handler != NULL)
+    {
+        nrf_drv_spi_evt_t event = { 0 };
+        m_bus.handler(&event);
+    }
+}
+
+/******************************************************************************
+function: GPIOTE, the BUSY pin is released right away
+******************************************************************************/
+static bool m_gpiote_init = false;
+
+bool nrf_drv_gpiote_is_init(void)
+{
+    return m_gpiote_init;
+}
+
+uint32_t nrf_drv_gpiote_init(void)
+{
+    m_gpiote_init = true;
+    return NRF_SUCCESS;
+}
+
+uint32_t nrf_drv_gpiote_in_init(nrf_drv_gpiote_pin_t pin,
+                                nrf_drv_gpiote_in_config_t const * p_config,
+                                nrf_drv_gpiote_evt_handler_t evt_handler)
+{
+    m_bus.busy_handler = evt_handler;
+    m_bus.busy_enabled = false;
+    return NRF_SUCCESS;
+}
+
+void nrf_drv_gpiote_in_uninit(nrf_drv_gpiote_pin_t pin)
+{
+    m_bus.busy_handler = NULL;
+    m_bus.busy_enabled = false;
+}
+
+void nrf_drv_gpiote_in_event_enable(nrf_drv_gpiote_pin_t pin, bool int_enable)
+{
+    m_bus.busy_enabled = true;
+    if (int_enable && m_bus.busy_handler != NULL && nrf_gpio_pin_read(pin))
+        m_bus.busy_handler(pin, 1);                   // the PORT event fires as soon as it is enabled
+}
+
+void nrf_drv_gpiote_in_event_disable(nrf_drv_gpiote_pin_t pin)
+{
+    m_bus.busy_enabled = false;
+}
+
+/******************************************************************************
+function: Simulator control
+******************************************************************************/
+void epd_sim_snapshot(const char *prefix)
+{
+    m_snapshot_prefix = prefix;
+}
+
+void epd_sim_hold_busy(bool hold)
+{
+    m_bus.busy_held = hold;
+    if (!hold && m_bus.busy_enabled && m_bus.busy_handler != NULL)
+        m_bus.busy_handler(EPD_BUSY_PIN, 1);
+}
+
+void epd_sim_set_temperature(int8_t temperature)
+{
+    m_sim.temperature = temperature;
+}
+
+const epd_sim_stats_t *epd_sim_stats(void)
+{
+    return &m_stats;
+}
+
+void epd_sim_stats_reset(void)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+const uint8_t *epd_sim_ram(uint8_t plane)
+{
+    return m_sim.ram[plane & 1];
+}
+
+#endif // EPD_SIMULATOR
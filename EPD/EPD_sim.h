@@ -0,0 +1,138 @@
+/*****************************************************************************
+* | File        : EPD_sim.h
+* | Function    : UC8176 simulator for host builds
+* | Info        :
+*   Built with -DEPD_SIMULATOR, this header stands in for the nRF51 SDK
+*   headers used by EPD_driver.c (GPIO, delays, SPI master, GPIOTE). The
+*   driver code runs unchanged and the bytes clocked out on the SPI bus
+*   are decoded by a model of the controller.
+*
+******************************************************************************/
+
+#ifndef __EPD_SIM_H
+#define __EPD_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**< Counters of the simulated bus and panel */
+typedef struct
+{
+    uint32_t commands;                                /**< command bytes (DC low) */
+    uint32_t bytes;                                   /**< data bytes (DC high), written or read */
+    uint32_t transfers;                               /**< SPI transfers */
+    uint32_t bus_errors;                              /**< CS/DC changed or tx buffer reused while a transfer was in flight */
+    uint32_t refreshes;                               /**< full refreshes */
+    uint32_t partial_refreshes;                       /**< refreshes inside a partial window */
+    uint32_t resets;                                  /**< RST pulses */
+    uint32_t refresh_ms;                              /**< modelled time spent refreshing */
+    uint32_t delay_ms;                                /**< time spent in DEV_Delay_ms/us by the drivers */
+} epd_sim_stats_t;
+
+/**
+ * Write a snapshot on every refresh to <prefix>NNNN.pbm (black/white)
+ * or <prefix>NNNN.ppm (black/white/red), NULL disables snapshots.
+**/
+void epd_sim_snapshot(const char *prefix);
+void epd_sim_set_temperature(int8_t temperature);
+const epd_sim_stats_t *epd_sim_stats(void);
+void epd_sim_stats_reset(void);
+
+/**< DTM1 (0x10, plane 0) or DTM2 (0x13, plane 1) of the controller, 50 bytes per row */
+const uint8_t *epd_sim_ram(uint8_t plane);
+
+/**< Completes the SPI transfer in flight, as its END interrupt would */
+void epd_sim_spi_irq(void);
+
+/**< Holds BUSY low, as a controller that never finishes, releasing it fires the GPIOTE event */
+void epd_sim_hold_busy(bool hold);
+
+/******************************************************************************
+ * Subset of the nRF51 SDK used by EPD_driver.c
+******************************************************************************/
+#ifndef NRF_SUCCESS                                  // the BLE test includes nrf_error.h as well
+#define NRF_SUCCESS                        0
+#define NRF_ERROR_BUSY                     17
+#endif
+#define APP_IRQ_PRIORITY_LOW               3
+
+#define NRF_GPIO_PIN_NOPULL                0
+
+void nrf_gpio_cfg_output(uint32_t pin);
+void nrf_gpio_cfg_input(uint32_t pin, uint32_t pull);
+void nrf_gpio_pin_write(uint32_t pin, uint32_t value);
+uint32_t nrf_gpio_pin_read(uint32_t pin);
+void nrf_delay_us(uint32_t us);
+void nrf_delay_ms(uint32_t ms);
+uint32_t sd_app_evt_wait(void);
+
+/**< RTC1 counter, the modelled clock advances 100 ms per call */
+uint32_t app_timer_cnt_get(void);
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from, uint32_t * p_ticks_diff);
+
+#define NRF_DRV_SPI_PIN_NOT_USED           0xFF
+#define NRF_DRV_SPI_FREQ_4M                0x40000000UL
+#define NRF_DRV_SPI_MODE_0                 0
+
+typedef struct
+{
+    uint8_t drv_inst_idx;
+} nrf_drv_spi_t;
+
+#define NRF_DRV_SPI_INSTANCE(id)           { .drv_inst_idx = (id) }
+
+typedef struct
+{
+    uint8_t sck_pin;
+    uint8_t mosi_pin;
+    uint8_t miso_pin;
+    uint8_t ss_pin;
+    uint8_t irq_priority;
+    uint8_t orc;
+    uint32_t frequency;
+    uint8_t mode;
+    uint8_t bit_order;
+} nrf_drv_spi_config_t;
+
+typedef struct
+{
+    uint8_t type;
+} nrf_drv_spi_evt_t;
+
+typedef void (*nrf_drv_spi_handler_t)(nrf_drv_spi_evt_t const * p_event);
+
+uint32_t nrf_drv_spi_init(nrf_drv_spi_t const * const p_instance,
+                          nrf_drv_spi_config_t const * p_config,
+                          nrf_drv_spi_handler_t handler);
+void nrf_drv_spi_uninit(nrf_drv_spi_t const * const p_instance);
+uint32_t nrf_drv_spi_transfer(nrf_drv_spi_t const * const p_instance,
+                              uint8_t const * p_tx_buffer, uint8_t tx_buffer_length,
+                              uint8_t * p_rx_buffer, uint8_t rx_buffer_length);
+
+typedef uint32_t nrf_drv_gpiote_pin_t;
+typedef uint8_t nrf_gpiote_polarity_t;
+
+typedef struct
+{
+    nrf_gpiote_polarity_t sense;
+    uint32_t pull;
+    bool is_watcher;
+    bool hi_accuracy;
+} nrf_drv_gpiote_in_config_t;
+
+#define GPIOTE_CONFIG_IN_SENSE_LOTOHI(hi_accu) \
+    { .is_watcher = false, .hi_accuracy = (hi_accu), .pull = NRF_GPIO_PIN_NOPULL, .sense = 1 }
+
+typedef void (*nrf_drv_gpiote_evt_handler_t)(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action);
+
+bool nrf_drv_gpiote_is_init(void);
+uint32_t nrf_drv_gpiote_init(void);
+uint32_t nrf_drv_gpiote_in_init(nrf_drv_gpiote_pin_t pin,
+                                nrf_drv_gpiote_in_config_t const * p_config,
+                                nrf_drv_gpiote_evt_handler_t evt_handler);
+void nrf_drv_gpiote_in_uninit(nrf_drv_gpiote_pin_t pin);
+void nrf_drv_gpiote_in_event_enable(nrf_drv_gpiote_pin_t pin, bool int_enable);
+void nrf_drv_gpiote_in_event_disable(nrf_drv_gpiote_pin_t pin);
+
+#endif
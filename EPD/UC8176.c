@@ -39,6 +39,8 @@ parameter:
 ******************************************************************************/
 static void EPD_4IN2_Reset(void)
 {
+    EPD_RamHashReset(); // the controller starts over, its ram is unknown
+    DEV_SPI_Flush();    // a data burst may still be clocked out
     DEV_Digital_Write(EPD_RST_PIN, 1);
     DEV_Delay_ms(10);
     for (UBYTE i = 0; i < 3; i++)
@@ -56,9 +58,7 @@ parameter:
 ******************************************************************************/
 void EPD_4IN2_ReadBusy(void)
 {
-    while(DEV_Digital_Read(EPD_BUSY_PIN) == 0) {      //LOW: idle, HIGH: busy
-        DEV_Delay_ms(100);
-    }
+    DEV_Wait_Busy_Sleep();                            //LOW: busy, HIGH: idle
 }
 
 void EPD_4IN2_PowerOn(void)
@@ -86,27 +86,199 @@ void EPD_4IN2_Refresh(void)
     EPD_4IN2_PowerOff();
 }
 
+/******************************************************************************
+function :	Turn On Display without waiting, callback runs once BUSY is released
+parameter:
+******************************************************************************/
+void EPD_4IN2_Refresh_Start(epd_busy_callback_t callback, void * p_context)
+{
+    EPD_4IN2_PowerOn();
+    EPD_WriteCommand(0x12);
+    DEV_Delay_ms(100);
+    DEV_Wait_Busy(callback, p_context);
+}
+
+void EPD_4IN2_Refresh_End(void)
+{
+    EPD_4IN2_PowerOff();
+}
+
+/******************************************************************************
+function :	Full refresh waveforms
+info:
+    The register LUT is the 20 degree waveform read from the OTP of the
+    panel (see docs/README.md), at the frame rate of the OTP LUT. It is only
+    loaded when configured, EPD_WAVEFORM_AUTO uses it from 15 degrees up and
+    keeps colder panels on the OTP LUT, which has its own temperature
+    compensation.
+******************************************************************************/
+static const UBYTE EPD_4IN2_LUT_VCOM[44] = {
+    0x60, 0x19, 0x19, 0x00, 0x00, 0x01,
+    0x00, 0x19, 0x19, 0x00, 0x00, 0x02,
+    0x00, 0x19, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x25, 0x26, 0x00, 0x00, 0x01,
+};
+
+static const UBYTE EPD_4IN2_LUT_W[42] = {
+    0x50, 0x19, 0x19, 0x00, 0x00, 0x01,
+    0x90, 0x19, 0x19, 0x00, 0x00, 0x02,
+    0x40, 0x19, 0x00, 0x00, 0x00, 0x01,
+    0xA0, 0x25, 0x26, 0x00, 0x00, 0x01,
+};
+
+static const UBYTE EPD_4IN2_LUT_B[42] = {
+    0xA0, 0x19, 0x19, 0x00, 0x00, 0x01,
+    0x90, 0x19, 0x19, 0x00, 0x00, 0x02,
+    0x80, 0x19, 0x00, 0x00, 0x00, 0x01,
+    0x50, 0x25, 0x26, 0x00, 0x00, 0x01,
+};
+
+typedef struct
+{
+    int8_t temperature;                               /**< lowest temperature the waveform is used at */
+    UBYTE pll;                                        /**< frame rate */
+    const UBYTE *lut[6];                              /**< LUT registers 0x20-0x25, all NULL for the OTP LUT */
+} EPD_4IN2_Waveform;
+
+static const EPD_4IN2_Waveform EPD_4IN2_WAVEFORMS[] = {
+    { INT8_MIN, 0x3c, { NULL } },                                           // OTP
+    { 15,       0x3c, { EPD_4IN2_LUT_VCOM, EPD_4IN2_LUT_W, EPD_4IN2_LUT_W,
+                        EPD_4IN2_LUT_B, EPD_4IN2_LUT_B } },                 // 50Hz
+};
+
+/**
+ * 4 grey levels: DTM1 and DTM2 hold the two bits of each pixel
+ */
+static const UBYTE EPD_4IN2_LUT_VCOM_GREY[44] = {
+    0x00, 0x0A, 0x00, 0x00, 0x00, 0x01,
+    0x60, 0x14, 0x14, 0x00, 0x00, 0x01,
+    0x00, 0x14, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x13, 0x0A, 0x01, 0x00, 0x01,
+};
+
+static const UBYTE EPD_4IN2_LUT_WW_GREY[42] = {
+    0x40, 0x0A, 0x00, 0x00, 0x00, 0x01,
+    0x90, 0x14, 0x14, 0x00, 0x00, 0x01,
+    0x10, 0x14, 0x0A, 0x00, 0x00, 0x01,
+    0xA0, 0x13, 0x01, 0x00, 0x00, 0x01,
+};
+
+static const UBYTE EPD_4IN2_LUT_BW_GREY[42] = {
+    0x40, 0x0A, 0x00, 0x00, 0x00, 0x01,
+    0x90, 0x14, 0x14, 0x00, 0x00, 0x01,
+    0x00, 0x14, 0x0A, 0x00, 0x00, 0x01,
+    0x99, 0x0C, 0x01, 0x03, 0x04, 0x01,
+};
+
+static const UBYTE EPD_4IN2_LUT_WB_GREY[42] = {
+    0x40, 0x0A, 0x00, 0x00, 0x00, 0x01,
+    0x90, 0x14, 0x14, 0x00, 0x00, 0x01,
+    0x00, 0x14, 0x0A, 0x00, 0x00, 0x01,
+    0x99, 0x0B, 0x04, 0x04, 0x01, 0x01,
+};
+
+static const UBYTE EPD_4IN2_LUT_BB_GREY[42] = {
+    0x80, 0x0A, 0x00, 0x00, 0x00, 0x01,
+    0x90, 0x14, 0x14, 0x00, 0x00, 0x01,
+    0x20, 0x14, 0x0A, 0x00, 0x00, 0x01,
+    0x50, 0x13, 0x01, 0x00, 0x00, 0x01,
+};
+
+static const UBYTE EPD_4IN2_LUT_25_GREY[42] = {
+    0x40, 0x0A, 0x00, 0x00, 0x00, 0x01,
+    0x90, 0x14, 0x14, 0x00, 0x00, 0x01,
+    0x10, 0x14, 0x0A, 0x00, 0x00, 0x01,
+    0xA0, 0x13, 0x01, 0x00, 0x00, 0x01,
+};
+
+static const EPD_4IN2_Waveform EPD_4IN2_WAVEFORM_GREY = {
+    0, 0x3c, { EPD_4IN2_LUT_VCOM_GREY, EPD_4IN2_LUT_WW_GREY, EPD_4IN2_LUT_BW_GREY,
+               EPD_4IN2_LUT_WB_GREY, EPD_4IN2_LUT_BB_GREY, EPD_4IN2_LUT_25_GREY },
+};
+
+static UBYTE m_waveform = EPD_WAVEFORM_OTP;
+
+static void EPD_4IN2_Load_Waveform(UBYTE waveform)
+{
+    const EPD_4IN2_Waveform *wf = waveform == EPD_WAVEFORM_GREY ? &EPD_4IN2_WAVEFORM_GREY
+                                                                : &EPD_4IN2_WAVEFORMS[waveform];
+
+    EPD_WriteCommand(0x00);         // panel setting
+    if (wf->lut[0] == NULL) {
+        EPD_WriteByte(0x1f);        // LUT from OTP
+    } else {
+        EPD_WriteByte(0x3f);        // LUT from register
+        for (UBYTE i = 0; i < ARRAY_SIZE(wf->lut); i++) {
+            if (wf->lut[i] != NULL)
+                EPD_WritePlane(0x20 + i, (UBYTE *)wf->lut[i], i == 0 ? 44 : 42);
+        }
+    }
+    EPD_WriteCommand(0x30);         // PLL control
+    EPD_WriteByte(wf->pll);
+    m_waveform = waveform;
+}
+
+UBYTE EPD_4IN2_Set_Waveform(UBYTE waveform, int8_t temperature)
+{
+    if (waveform == EPD_WAVEFORM_AUTO) {
+        waveform = EPD_WAVEFORM_OTP;
+        if (temperature != EPD_TEMPERATURE_UNKNOWN) {
+            for (UBYTE i = 0; i < ARRAY_SIZE(EPD_4IN2_WAVEFORMS); i++)
+                if (temperature >= EPD_4IN2_WAVEFORMS[i].temperature) waveform = i;
+        }
+    }
+    if (waveform >= ARRAY_SIZE(EPD_4IN2_WAVEFORMS) && waveform != EPD_WAVEFORM_GREY) waveform = EPD_WAVEFORM_OTP;
+
+    EPD_4IN2_Load_Waveform(waveform);
+    return waveform;
+}
+
+/******************************************************************************
+function :	Read the temperature sensor
+parameter:
+info:
+    First byte is the temperature in degrees C, bit 7 of the second one adds 0.5
+******************************************************************************/
+bool EPD_4IN2_Read_Temperature(int8_t *temperature)
+{
+    UBYTE data[2];
+
+    EPD_WriteCommand(0x40);
+    EPD_4IN2_ReadBusy();
+    EPD_ReadData(data, 2);
+    if (data[0] == 0xFF && data[1] == 0xFF) return false; // nothing is driving SDA
+
+    *temperature = (int8_t)data[0];
+    return true;
+}
+
 /******************************************************************************
 function :	Initialize the e-Paper register
 parameter:
 ******************************************************************************/
 void EPD_4IN2_Init(void)
 {
-	EPD_4IN2_Reset();
+	// every register that may have been changed is written below, the reset only wakes the controller up
+	if (!EPD_IsAwake())
+		EPD_4IN2_Reset();
 
-	EPD_WriteCommand(0x00);			// panel setting
-	EPD_WriteByte(0x1f);		    // 400x300 B/W mode, LUT from OTP
+	EPD_4IN2_Load_Waveform(EPD_WAVEFORM_OTP);	// 400x300 B/W mode, LUT from OTP, 50Hz
 
 	EPD_WriteCommand(0x50);         // VCOM AND DATA INTERVAL SETTING
 	EPD_WriteByte(0x97);            // LUTB=0 LUTW=1 interval=10
+
+	EPD_SetAwake(true);
 }
 
 void EPD_4IN2B_V2_Init(void)
 {
-    EPD_4IN2_Reset();
+    if (!EPD_IsAwake())
+        EPD_4IN2_Reset();
 
     EPD_WriteCommand(0x00);
     EPD_WriteByte(0x0f);
+
+    EPD_SetAwake(true);
 }
 
 /******************************************************************************
@@ -119,19 +291,8 @@ void EPD_4IN2_Clear(void)
     Width = (EPD_4IN2_WIDTH % 8 == 0)? (EPD_4IN2_WIDTH / 8 ): (EPD_4IN2_WIDTH / 8 + 1);
     Height = EPD_4IN2_HEIGHT;
 
-    EPD_WriteCommand(0x10);
-    for (UWORD j = 0; j < Height; j++) {
-        for (UWORD i = 0; i < Width; i++) {
-            EPD_WriteByte(0xFF);
-        }
-    }
-
-    EPD_WriteCommand(0x13);
-    for (UWORD j = 0; j < Height; j++) {
-        for (UWORD i = 0; i < Width; i++) {
-            EPD_WriteByte(0xFF);
-        }
-    }
+    EPD_FillPlane(0x10, 0xFF, Width * Height);
+    EPD_FillPlane(0x13, 0xFF, Width * Height);
 
     EPD_4IN2_Refresh();
 }
@@ -154,44 +315,102 @@ static void _setPartialRamArea(UWORD x, UWORD y, UWORD w, UWORD h)
   EPD_WriteByte(0x01);
 }
 
-void EPD_4IN2_Write_Image(UBYTE *black, UBYTE *color, UWORD x, UWORD y, UWORD w, UWORD h)
+static bool EPD_4IN2_Write_Image_Begin(UBYTE plane, UWORD x, UWORD y, UWORD w, UWORD h)
 {
     UWORD wb = (w + 7) / 8; // width bytes, bitmaps are padded
     x -= x % 8; // byte boundary
     w = wb * 8; // byte boundary
-    if (x + w > EPD_4IN2_WIDTH || y + h > EPD_4IN2_HEIGHT) return;
+    if (plane != 0x10 && plane != 0x13) return false;
+    if (w == 0 || h == 0) return false;
+    if (x + w > EPD_4IN2_WIDTH || y + h > EPD_4IN2_HEIGHT) return false;
     EPD_WriteCommand(0x91); // partial in
     _setPartialRamArea(x, y, w, h);
-    EPD_WriteCommand(0x13);
-    for (UWORD i = 0; i < h; i++) {
-        for (UWORD j = 0; j < w / 8; j++) {
-            EPD_WriteByte(black[j + i * wb]);
-        }
-    }
+    EPD_WriteCommand(plane);
+    if (w == EPD_4IN2_WIDTH) EPD_RamHashWindow(plane, y, h);
+    return true;
+}
+
+static void EPD_4IN2_Write_Image_End(void)
+{
     EPD_WriteCommand(0x92); // partial out
 }
 
+void EPD_4IN2_Write_Image(UBYTE *black, UBYTE *color, UWORD x, UWORD y, UWORD w, UWORD h)
+{
+    UWORD wb = (w + 7) / 8; // width bytes, bitmaps are padded
+    if (!EPD_4IN2_Write_Image_Begin(0x13, x, y, w, h)) return;
+    EPD_WriteData(black, wb * h);
+    EPD_4IN2_Write_Image_End();
+}
+
 void EPD_4IN2B_V2_Write_Image(UBYTE *black, UBYTE *color, UWORD x, UWORD y, UWORD w, UWORD h)
 {
     UWORD wb = (w + 7) / 8; // width bytes, bitmaps are padded
-    x -= x % 8; // byte boundary
-    w = wb * 8; // byte boundary
+    if (!EPD_4IN2_Write_Image_Begin(0x10, x, y, w, h)) return;
+    if (black)
+        EPD_WriteData(black, wb * h);
+    else
+        EPD_FillData(0xFF, wb * h);
+    if (color)
+        EPD_WritePlane(0x13, color, wb * h);
+    else
+        EPD_FillPlane(0x13, 0xFF, wb * h);
+    if (wb * 8 >= EPD_4IN2_WIDTH) EPD_RamHashWindow(0x13, y, h);
+    EPD_4IN2_Write_Image_End();
+}
+
+/******************************************************************************
+function :	Fast refresh of a window with the LUT loaded to registers
+parameter:
+info:
+    Every pixel is driven to its new colour, so the old data in DTM1 is not
+    needed. Ghosting builds up, a full refresh should follow now and then.
+******************************************************************************/
+#define T1 25 // charge balance pre-phase
+#define T2  1 // charge balance pre-phase extension
+#define T3  2 // sustain phase
+#define T4 25 // colour change phase
+
+static const UBYTE EPD_4IN2_LUT_VCOM_PARTIAL[44] = {
+    0x00, T1, T2, T3, T4, 0x01,
+    0x00, 0x01, 0x00, 0x00, 0x00, 0x01, // gnd phase
+};
+
+static const UBYTE EPD_4IN2_LUT_W_PARTIAL[42] = {
+    0x5A, T1, T2, T3, T4, 0x01,         // 01 01 10 10
+    0x00, 0x01, 0x00, 0x00, 0x00, 0x01, // gnd phase
+};
+
+static const UBYTE EPD_4IN2_LUT_B_PARTIAL[42] = {
+    0xA5, T1, T2, T3, T4, 0x01,         // 10 10 01 01
+    0x00, 0x01, 0x00, 0x00, 0x00, 0x01, // gnd phase
+};
+
+void EPD_4IN2_Refresh_Partial(UWORD x, UWORD y, UWORD w, UWORD h)
+{
+    if (w == 0 || h == 0) return;
     if (x + w > EPD_4IN2_WIDTH || y + h > EPD_4IN2_HEIGHT) return;
+
+    EPD_WriteCommand(0x00);         // panel setting
+    EPD_WriteByte(0x3f);            // LUT from register
+    EPD_WriteCommand(0x30);         // PLL control
+    EPD_WriteByte(0x3a);            // 100Hz
+    EPD_WritePlane(0x20, (UBYTE *)EPD_4IN2_LUT_VCOM_PARTIAL, sizeof(EPD_4IN2_LUT_VCOM_PARTIAL));
+    EPD_WritePlane(0x21, (UBYTE *)EPD_4IN2_LUT_W_PARTIAL, sizeof(EPD_4IN2_LUT_W_PARTIAL)); // WW
+    EPD_WritePlane(0x22, (UBYTE *)EPD_4IN2_LUT_W_PARTIAL, sizeof(EPD_4IN2_LUT_W_PARTIAL)); // BW
+    EPD_WritePlane(0x23, (UBYTE *)EPD_4IN2_LUT_B_PARTIAL, sizeof(EPD_4IN2_LUT_B_PARTIAL)); // WB
+    EPD_WritePlane(0x24, (UBYTE *)EPD_4IN2_LUT_B_PARTIAL, sizeof(EPD_4IN2_LUT_B_PARTIAL)); // BB
+
+    EPD_4IN2_PowerOn();
     EPD_WriteCommand(0x91); // partial in
     _setPartialRamArea(x, y, w, h);
-    EPD_WriteCommand(0x10);
-    for (UWORD i = 0; i < h; i++) {
-        for (UWORD j = 0; j < w / 8; j++) {
-            EPD_WriteByte(black ? black[j + i * wb] : 0xFF);
-        }
-    }
-    EPD_WriteCommand(0x13);
-    for (UWORD i = 0; i < h; i++) {
-        for (UWORD j = 0; j < w / 8; j++) {
-            EPD_WriteByte(color ? color[j + i * wb] : 0xFF);
-        }
-    }
+    EPD_WriteCommand(0x12);
+    DEV_Delay_ms(10);
+    EPD_4IN2_ReadBusy();
     EPD_WriteCommand(0x92); // partial out
+    EPD_4IN2_PowerOff();
+
+    EPD_4IN2_Load_Waveform(m_waveform);
 }
 
 /******************************************************************************
@@ -204,19 +423,37 @@ void EPD_4IN2_Sleep(void)
 
 	EPD_WriteCommand(0x07);
 	EPD_WriteByte(0XA5);
+	EPD_SetAwake(false);
 }
 
 const epd_driver_t epd_driver_4in2 = {
     .id = EPD_DRIVER_4IN2,
 	.width = EPD_4IN2_WIDTH,
 	.height = EPD_4IN2_HEIGHT,
+    .caps = {
+        .planes = 1,
+        .grey_levels = 4,
+        .lut_slots = 6,
+        .black_cmd = 0x13,
+        .color_cmd = 0,
+        .flags = EPD_CAPS_PARTIAL | EPD_CAPS_TEMPERATURE | EPD_CAPS_WAVEFORM,
+    },
     .init = EPD_4IN2_Init,
     .clear = EPD_4IN2_Clear,
     .send_command = EPD_WriteCommand,
 	.send_byte = EPD_WriteByte,
     .send_data = EPD_WriteData,
+    .write_plane = EPD_WritePlane,
+    .fill_plane = EPD_FillPlane,
     .write_image = EPD_4IN2_Write_Image,
+    .write_image_begin = EPD_4IN2_Write_Image_Begin,
+    .write_image_end = EPD_4IN2_Write_Image_End,
     .refresh = EPD_4IN2_Refresh,
+    .refresh_start = EPD_4IN2_Refresh_Start,
+    .refresh_end = EPD_4IN2_Refresh_End,
+    .refresh_partial = EPD_4IN2_Refresh_Partial,
+    .read_temperature = EPD_4IN2_Read_Temperature,
+    .set_waveform = EPD_4IN2_Set_Waveform,
     .sleep = EPD_4IN2_Sleep,
 };
 
@@ -224,12 +461,27 @@ const epd_driver_t epd_driver_4in2bv2 = {
     .id = EPD_DRIVER_4IN2B_V2,
 	.width = EPD_4IN2_WIDTH,
 	.height = EPD_4IN2_HEIGHT,
+    .caps = {
+        .planes = 2,
+        .grey_levels = 2,
+        .lut_slots = 6,
+        .black_cmd = 0x10,
+        .color_cmd = 0x13,
+        .flags = EPD_CAPS_TEMPERATURE,
+    },
     .init = EPD_4IN2B_V2_Init,
     .clear = EPD_4IN2_Clear,
     .send_command = EPD_WriteCommand,
 	.send_byte = EPD_WriteByte,
     .send_data = EPD_WriteData,
+    .write_plane = EPD_WritePlane,
+    .fill_plane = EPD_FillPlane,
     .write_image = EPD_4IN2B_V2_Write_Image,
+    .write_image_begin = EPD_4IN2_Write_Image_Begin,
+    .write_image_end = EPD_4IN2_Write_Image_End,
     .refresh = EPD_4IN2_Refresh,
+    .refresh_start = EPD_4IN2_Refresh_Start,
+    .refresh_end = EPD_4IN2_Refresh_End,
+    .read_temperature = EPD_4IN2_Read_Temperature,
     .sleep = EPD_4IN2_Sleep,
 };
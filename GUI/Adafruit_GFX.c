@@ -44,6 +44,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef MIN
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 #endif
+#ifndef MAX
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
 #ifndef SWAP
 #define SWAP(a, b, T) do { T t = a; a = b; b = t; } while (0)
 #endif
@@ -71,23 +74,36 @@ static void GFX_u8g2_draw_hv_line(u8g2_font_t *u8g2, int16_t x, int16_t y,
   }
 }
 
+static void GFX_bindWriter(Adafruit_GFX *gfx);
+
 /**************************************************************************/
 /*!
    @brief    Instatiate a GFX context for graphics
    @param    w   Display width, in pixels
    @param    h   Display height, in pixels
-   @param    buffer_height Page buffer height
+   @param    buffer Page buffer, owned by the caller
+   @param    size   Page buffer size in bytes, a page is as many rows as
+                    fit, up to the full height
+   @return   false if the buffer does not hold a single row
 */
 /**************************************************************************/
-void GFX_begin(Adafruit_GFX *gfx, int16_t w, int16_t h, int16_t buffer_height) {
+bool GFX_begin(Adafruit_GFX *gfx, int16_t w, int16_t h, uint8_t *buffer, uint32_t size) {
   memset(gfx, 0, sizeof(Adafruit_GFX));
   memset(&gfx->u8g2, 0, sizeof(gfx->u8g2));
+  if (w <= 0 || h <= 0) return false;
+  uint16_t stride = (w + 7) / 8;
+  uint32_t rows = size / stride;
+  if (rows == 0) return false;
+
   gfx->WIDTH = gfx->_width = w;
   gfx->HEIGHT = gfx->_height = h;
   gfx->u8g2.draw_hv_line = GFX_u8g2_draw_hv_line;
-  gfx->buffer = malloc(((gfx->WIDTH + 7) / 8) * buffer_height);
-  gfx->page_height = buffer_height;
+  gfx->buffer = buffer;
+  gfx->stride = stride;
+  gfx->page_height = rows < (uint32_t)h ? (int16_t)rows : h;
   gfx->total_pages = (gfx->HEIGHT / gfx->page_height) + (gfx->HEIGHT % gfx->page_height > 0);
+  GFX_bindWriter(gfx);
+  return true;
 }
 
 /**************************************************************************/
@@ -95,37 +111,108 @@ void GFX_begin(Adafruit_GFX *gfx, int16_t w, int16_t h, int16_t buffer_height) {
    @brief    Instatiate a 3-color GFX context for graphics
    @param    w   Display width, in pixels
    @param    h   Display height, in pixels
-   @param    buffer_height Page buffer height, should be multiple of 2
+   @param    buffer Page buffer, owned by the caller
+   @param    size   Page buffer size in bytes, shared by the black and red
+                    planes
+   @return   false if the buffer does not hold a single row of both planes
 */
 /**************************************************************************/
-void GFX_begin_3c(Adafruit_GFX *gfx, int16_t w, int16_t h, int16_t buffer_height) {
-  GFX_begin(gfx, w, h, buffer_height);
-  gfx->page_height = buffer_height / 2;
-  gfx->color = gfx->buffer + ((gfx->WIDTH + 7) / 8) * gfx->page_height;
-  gfx->total_pages = (gfx->HEIGHT / gfx->page_height) + (gfx->HEIGHT % gfx->page_height > 0);
+bool GFX_begin_3c(Adafruit_GFX *gfx, int16_t w, int16_t h, uint8_t *buffer, uint32_t size) {
+  if (!GFX_begin(gfx, w, h, buffer, size / 2)) return false;
+  gfx->color = gfx->buffer + gfx->stride * gfx->page_height;
+  GFX_bindWriter(gfx);
+  return true;
 }
 
 void GFX_end(Adafruit_GFX *gfx) {
-  if (gfx->buffer) free(gfx->buffer);
+  gfx->buffer = gfx->color = NULL;
 }
 
 void GFX_firstPage(Adafruit_GFX *gfx) {
   GFX_fillScreen(gfx, GFX_WHITE);
   gfx->current_page = 0;
+  gfx->page_y = 0;
+  gfx->bin = 0;
 }
 
 bool GFX_nextPage(Adafruit_GFX *gfx, buffer_callback callback) {
-  int16_t page_y = gfx->current_page * gfx->page_height;
-  int16_t height = MIN(gfx->page_height, gfx->HEIGHT - page_y);
+  int16_t height = MIN(gfx->page_height, gfx->HEIGHT - gfx->page_y);
   if (callback)
-    callback(gfx->buffer, gfx->color, 0, page_y, gfx->WIDTH, height);
+    callback(gfx->buffer, gfx->color, 0, gfx->page_y, gfx->WIDTH, height);
 
   gfx->current_page++;
+  gfx->page_y += gfx->page_height;
+  gfx->bin = 0;
   GFX_fillScreen(gfx, GFX_WHITE);
 
   return gfx->current_page < gfx->total_pages;
 }
 
+/**************************************************************************/
+/*!
+   @brief    Enable page binning: the pages touched by each primitive are
+             recorded while drawing the first page, later pages only draw
+             the primitives that touch them. The drawing code has to issue
+             the same primitives for every page.
+   @param    bins   One byte per primitive, primitives past the end are
+                    always drawn
+   @param    size   Number of bytes in bins
+*/
+/**************************************************************************/
+void GFX_setPageBins(Adafruit_GFX *gfx, uint8_t *bins, uint16_t size) {
+  if (gfx->total_pages > 16) return; // page numbers are stored in 4 bits
+  gfx->bins = bins;
+  gfx->bins_size = size;
+}
+
+/**************************************************************************/
+/*!
+   @brief    Start a primitive
+   @return   false if the primitive does not touch the current page, it is
+             done then and must not be drawn
+*/
+/**************************************************************************/
+static bool GFX_binBegin(Adafruit_GFX *gfx) {
+  if (gfx->bins == NULL || gfx->bin_depth++ > 0) return true;
+
+  if (gfx->current_page == 0) {
+    gfx->bin_record = true;
+    gfx->bin_first = 0x0F;
+    gfx->bin_last = 0;
+    return true;
+  }
+  if (gfx->bin < gfx->bins_size) {
+    uint8_t bin = gfx->bins[gfx->bin];
+    if (gfx->current_page < (bin >> 4) || gfx->current_page > (bin & 0x0F)) {
+      gfx->bin_depth--;
+      gfx->bin++;
+      return false;
+    }
+  }
+  return true;
+}
+
+static void GFX_binEnd(Adafruit_GFX *gfx) {
+  if (gfx->bins == NULL || --gfx->bin_depth > 0) return;
+
+  if (gfx->bin_record && gfx->bin < gfx->bins_size)
+    gfx->bins[gfx->bin] = gfx->bin_first << 4 | gfx->bin_last; // first > last: off screen
+  gfx->bin_record = false;
+  gfx->bin++;
+}
+
+/**************************************************************************/
+/*!
+   @brief    Record buffer rows [y0, y1] as touched by the current primitive
+*/
+/**************************************************************************/
+static void GFX_binMark(Adafruit_GFX *gfx, int16_t y0, int16_t y1) {
+  uint8_t first = y0 / gfx->page_height;
+  uint8_t last = y1 / gfx->page_height;
+  if (first < gfx->bin_first) gfx->bin_first = first;
+  if (last > gfx->bin_last) gfx->bin_last = last;
+}
+
 /**************************************************************************/
 /*!
     @brief      Set rotation setting for display
@@ -146,8 +233,130 @@ void GFX_setRotation(Adafruit_GFX *gfx, GFX_Rotate r) {
     gfx->_height = gfx->WIDTH;
     break;
   }
+  GFX_bindWriter(gfx);
+}
+
+/**************************************************************************/
+/*!
+   @brief    Get the part of the screen the current page can show, in rotated
+             coordinates. Whole screen while the page bins are recorded.
+   @param    win   x0, y0, x1, y1, inclusive
+*/
+/**************************************************************************/
+static void GFX_getWindow(Adafruit_GFX *gfx, int16_t win[4]) {
+  int16_t y0 = 0, y1 = gfx->HEIGHT - 1;
+
+  if (!gfx->bin_record) {
+    y0 = gfx->page_y;
+    y1 = MIN(y0 + gfx->page_height, gfx->HEIGHT) - 1;
+  }
+  win[0] = 0;
+  win[1] = 0;
+  win[2] = gfx->_width - 1;
+  win[3] = gfx->_height - 1;
+  switch (gfx->rotation) {
+    case GFX_ROTATE_0:
+      win[1] = y0;
+      win[3] = y1;
+      break;
+    case GFX_ROTATE_90:
+      win[0] = y0;
+      win[2] = y1;
+      break;
+    case GFX_ROTATE_180:
+      win[1] = gfx->HEIGHT - 1 - y1;
+      win[3] = gfx->HEIGHT - 1 - y0;
+      break;
+    case GFX_ROTATE_270:
+      win[0] = gfx->HEIGHT - 1 - y1;
+      win[2] = gfx->HEIGHT - 1 - y0;
+      break;
+  }
 }
 
+/**************************************************************************/
+/*!
+   @brief    Check if the box [x0, x1] x [y0, y1] misses the current page
+*/
+/**************************************************************************/
+static bool GFX_outsideWindow(Adafruit_GFX *gfx, int16_t x0, int16_t y0,
+                              int16_t x1, int16_t y1) {
+  int16_t win[4];
+  GFX_getWindow(gfx, win);
+  return x1 < win[0] || y1 < win[1] || x0 > win[2] || y0 > win[3];
+}
+
+
+/**************************************************************************/
+/*!
+   @brief    Set a pixel given in buffer (unrotated) coordinates, x must be
+             on screen, rows outside the current page are dropped
+*/
+/**************************************************************************/
+static inline void GFX_plot(Adafruit_GFX *gfx, uint16_t x, uint16_t y, uint16_t color) {
+  if (gfx->bin_record)
+    GFX_binMark(gfx, y, y);
+  y -= gfx->page_y;
+  if (y >= gfx->page_height) return;
+
+  uint8_t *p = gfx->buffer + y * gfx->stride + (x >> 3);
+  uint8_t mask = 0x80 >> (x & 7);
+  if (color == GFX_WHITE)
+    *p |= mask;
+  else
+    *p &= ~mask;
+}
+
+static inline void GFX_plot_3c(Adafruit_GFX *gfx, uint16_t x, uint16_t y, uint16_t color) {
+  if (gfx->bin_record)
+    GFX_binMark(gfx, y, y);
+  y -= gfx->page_y;
+  if (y >= gfx->page_height) return;
+
+  uint16_t i = y * gfx->stride + (x >> 3);
+  uint8_t mask = 0x80 >> (x & 7);
+  gfx->buffer[i] |= mask; // white
+  gfx->color[i] |= mask;
+  if (color == GFX_BLACK)
+    gfx->buffer[i] &= ~mask;
+  else if (color == GFX_RED)
+    gfx->color[i] &= ~mask;
+}
+
+/**************************************************************************/
+/*!
+   @brief    Pixel writers, one per rotation and color mode, so drawing
+             loops do not switch on either for every pixel
+    @param   x   x coordinate, rotated
+    @param   y   y coordinate, rotated
+   @param    color 16-bit 5-6-5 Color to fill with
+*/
+/**************************************************************************/
+#define GFX_PIXEL_WRITER(name, plot, px, py)                                  \
+  static void name(Adafruit_GFX *gfx, int16_t x, int16_t y, uint16_t color) { \
+    if ((uint16_t)x >= (uint16_t)gfx->_width ||                               \
+        (uint16_t)y >= (uint16_t)gfx->_height)                                \
+      return;                                                                 \
+    plot(gfx, px, py, color);                                                 \
+  }
+
+GFX_PIXEL_WRITER(GFX_writePixel_0, GFX_plot, x, y)
+GFX_PIXEL_WRITER(GFX_writePixel_90, GFX_plot, gfx->WIDTH - 1 - y, x)
+GFX_PIXEL_WRITER(GFX_writePixel_180, GFX_plot, gfx->WIDTH - 1 - x, gfx->HEIGHT - 1 - y)
+GFX_PIXEL_WRITER(GFX_writePixel_270, GFX_plot, y, gfx->HEIGHT - 1 - x)
+GFX_PIXEL_WRITER(GFX_writePixel_3c_0, GFX_plot_3c, x, y)
+GFX_PIXEL_WRITER(GFX_writePixel_3c_90, GFX_plot_3c, gfx->WIDTH - 1 - y, x)
+GFX_PIXEL_WRITER(GFX_writePixel_3c_180, GFX_plot_3c, gfx->WIDTH - 1 - x, gfx->HEIGHT - 1 - y)
+GFX_PIXEL_WRITER(GFX_writePixel_3c_270, GFX_plot_3c, y, gfx->HEIGHT - 1 - x)
+
+static void (*const GFX_pixel_writers[2][4])(Adafruit_GFX *, int16_t, int16_t, uint16_t) = {
+  { GFX_writePixel_0, GFX_writePixel_90, GFX_writePixel_180, GFX_writePixel_270 },
+  { GFX_writePixel_3c_0, GFX_writePixel_3c_90, GFX_writePixel_3c_180, GFX_writePixel_3c_270 },
+};
+
+static void GFX_bindWriter(Adafruit_GFX *gfx) {
+  gfx->write_pixel = GFX_pixel_writers[gfx->color != NULL][gfx->rotation];
+}
 
 /**************************************************************************/
 /*!
@@ -158,42 +367,106 @@ void GFX_setRotation(Adafruit_GFX *gfx, GFX_Rotate r) {
 */
 /**************************************************************************/
 void GFX_drawPixel(Adafruit_GFX *gfx, int16_t x, int16_t y, uint16_t color) {
-  if (x < 0 || x >= gfx->_width || y < 0 || y >= gfx->_height) return;
-  
+  if (!GFX_binBegin(gfx)) return;
+  gfx->write_pixel(gfx, x, y, color);
+  GFX_binEnd(gfx);
+}
+
+/**************************************************************************/
+/*!
+   @brief    Set or clear the bits [x0, x1) of a buffer row, whole bytes
+             are written with memset
+*/
+/**************************************************************************/
+static void GFX_fillBits(uint8_t *row, int16_t x0, int16_t x1, bool set) {
+  uint8_t *p = row + x0 / 8;
+  uint8_t *end = row + (x1 - 1) / 8;
+  uint8_t first = 0xFF >> (x0 & 7);
+  uint8_t last = 0xFF << (7 - ((x1 - 1) & 7));
+
+  if (p == end) {
+    first &= last;
+    *p = set ? (*p | first) : (*p & ~first);
+    return;
+  }
+  *p = set ? (*p | first) : (*p & ~first);
+  p++;
+  if (end > p)
+    memset(p, set ? 0xFF : 0x00, end - p);
+  *end = set ? (*end | last) : (*end & ~last);
+}
+
+/**************************************************************************/
+/*!
+   @brief    Fill a rectangle given in buffer (unrotated) coordinates,
+             clipped to the screen and the current page
+*/
+/**************************************************************************/
+static void GFX_fillBufferRect(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t w, int16_t h,
+                               uint16_t color) {
+  int16_t page_y = gfx->page_y;
+  int16_t x1 = x + w, y1 = y + h;
+
+  if (x < 0) x = 0;
+  if (x1 > gfx->WIDTH) x1 = gfx->WIDTH;
+  if (y < 0) y = 0;
+  if (y1 > gfx->HEIGHT) y1 = gfx->HEIGHT;
+  if (x >= x1 || y >= y1) return;
+  if (gfx->bin_record)
+    GFX_binMark(gfx, y, y1 - 1);
+
+  if (y < page_y) y = page_y;
+  if (y1 > page_y + gfx->page_height) y1 = page_y + gfx->page_height;
+  if (y >= y1) return;
+
+  uint16_t stride = gfx->stride;
+  // same colors as GFX_drawPixel: black or red clears one plane, anything else is white
+  bool black = color == GFX_BLACK || (gfx->color == NULL && color != GFX_WHITE);
+  bool red = gfx->color != NULL && color == GFX_RED;
+
+  for (int16_t j = y - page_y; j < y1 - page_y; j++) {
+    GFX_fillBits(gfx->buffer + j * stride, x, x1, !black);
+    if (gfx->color != NULL)
+      GFX_fillBits(gfx->color + j * stride, x, x1, !red);
+  }
+}
+
+/**************************************************************************/
+/*!
+   @brief    Turn a line length into the span GFX_drawLine draws from p to
+             p + len - 1, both ends included: a length of 0 or less still
+             draws 2 - len pixels, ending at p
+*/
+/**************************************************************************/
+static void GFX_lineSpan(int16_t *p, int16_t *len) {
+  if (*len <= 0) {
+    *p += *len - 1;
+    *len = 2 - *len;
+  }
+}
+
+/**************************************************************************/
+/*!
+   @brief    Fill a rectangle given in rotated coordinates as byte spans,
+             w and h must be positive
+*/
+/**************************************************************************/
+static void GFX_fillSpanRect(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t w, int16_t h,
+                             uint16_t color) {
   switch (gfx->rotation) {
     case GFX_ROTATE_0:
+      GFX_fillBufferRect(gfx, x, y, w, h, color);
       break;
     case GFX_ROTATE_90:
-      SWAP(x, y, int16_t);
-      x = gfx->WIDTH - x - 1;
+      GFX_fillBufferRect(gfx, gfx->WIDTH - y - h, x, h, w, color);
       break;
     case GFX_ROTATE_180:
-      x = gfx->WIDTH - x - 1;
-      y = gfx->HEIGHT - y - 1;
+      GFX_fillBufferRect(gfx, gfx->WIDTH - x - w, gfx->HEIGHT - y - h, w, h, color);
       break;
     case GFX_ROTATE_270:
-      SWAP(x, y, int16_t);
-      y = gfx->HEIGHT - y - 1;
+      GFX_fillBufferRect(gfx, y, gfx->HEIGHT - x - w, h, w, color);
       break;
   }
-
-  y -= gfx->current_page * gfx->page_height;
-  if (y < 0 || y >= gfx->page_height) return;
-
-  uint16_t i = x / 8 + y * (gfx->WIDTH / 8);
-  if (gfx->color != NULL) {
-    gfx->buffer[i] |= 0x80 >> (x & 7); // white
-    gfx->color[i] |= 0x80 >> (x & 7);
-    if (color == GFX_BLACK)
-      gfx->buffer[i] &= ~(0x80 >> (x & 7));
-    else if (color == GFX_RED)
-      gfx->color[i] &= ~(0x80 >> (x & 7));
-  } else {
-    if (color == GFX_WHITE)
-      gfx->buffer[i] |= 0x80 >> (x & 7);
-    else
-      gfx->buffer[i] &= ~(0x80 >> (x & 7));
-  }
 }
 
 /**************************************************************************/
@@ -208,10 +481,23 @@ void GFX_drawPixel(Adafruit_GFX *gfx, int16_t x, int16_t y, uint16_t color) {
 /**************************************************************************/
 void GFX_drawLine(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t x1, int16_t y1,
                    uint16_t color) {
+  if (!GFX_binBegin(gfx)) return;
+
+  // reject lines with both ends on the same outer side of the page (outcodes)
+  int16_t win[4];
+  GFX_getWindow(gfx, win);
+  if ((x0 < win[0] && x1 < win[0]) || (x0 > win[2] && x1 > win[2]) ||
+      (y0 < win[1] && y1 < win[1]) || (y0 > win[3] && y1 > win[3])) {
+    GFX_binEnd(gfx);
+    return;
+  }
+
   int16_t steep = ABS(y1 - y0) > ABS(x1 - x0);
   if (steep) {
     SWAP(x0, y0, int16_t);
     SWAP(x1, y1, int16_t);
+    SWAP(win[0], win[1], int16_t);
+    SWAP(win[2], win[3], int16_t);
   }
 
   if (x0 > x1) {
@@ -232,11 +518,34 @@ void GFX_drawLine(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t x1, int16_t
     ystep = -1;
   }
 
+  // Clip the steps along x to the window. Step k is on row
+  // y0 + ystep * m(k), m(k) = ceil((k * dy - err) / dx), which lets the
+  // rows before and after the window be cut without walking them.
+  int32_t k = MAX(win[0] - x0, 0);
+  int32_t last = MIN(win[2], x1) - x0;
+  int32_t before = ystep > 0 ? win[1] - y0 : y0 - win[3];
+  int32_t after = ystep > 0 ? win[3] - y0 : y0 - win[1];
+  if (dy > 0) {
+    if (before > 0)
+      k = MAX(k, ((before - 1) * dx + err) / dy + 1);
+    last = MIN(last, (after * dx + err) / dy);
+  }
+  if (k > last) {
+    GFX_binEnd(gfx);
+    return;
+  }
+  int32_t t = k * dy - err;
+  int32_t m = t > 0 ? (t + dx - 1) / dx : 0;
+  err = err - k * dy + m * dx;
+  y0 += ystep * m;
+  x1 = x0 + last;
+  x0 += k;
+
   for (; x0 <= x1; x0++) {
     if (steep) {
-      GFX_drawPixel(gfx, y0, x0, color);
+      gfx->write_pixel(gfx, y0, x0, color);
     } else {
-      GFX_drawPixel(gfx, x0, y0, color);
+      gfx->write_pixel(gfx, x0, y0, color);
     }
     err -= dy;
     if (err < 0) {
@@ -244,6 +553,7 @@ void GFX_drawLine(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t x1, int16_t
       err += dx;
     }
   }
+  GFX_binEnd(gfx);
 }
                                   
 /**************************************************************************/
@@ -257,7 +567,10 @@ void GFX_drawLine(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t x1, int16_t
 /**************************************************************************/
 void GFX_drawFastVLine(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t h,
                        uint16_t color) {
-  GFX_drawLine(gfx, x, y, x, y + h - 1, color);
+  if (!GFX_binBegin(gfx)) return;
+  GFX_lineSpan(&y, &h);
+  GFX_fillSpanRect(gfx, x, y, 1, h, color);
+  GFX_binEnd(gfx);
 }
 
 /**************************************************************************/
@@ -271,7 +584,10 @@ void GFX_drawFastVLine(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t h,
 /**************************************************************************/
 void GFX_drawFastHLine(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t w,
                        uint16_t color) {
-  GFX_drawLine(gfx, x, y, x + w - 1, y, color);
+  if (!GFX_binBegin(gfx)) return;
+  GFX_lineSpan(&x, &w);
+  GFX_fillSpanRect(gfx, x, y, w, 1, color);
+  GFX_binEnd(gfx);
 }
 
 /**************************************************************************/
@@ -286,9 +602,13 @@ void GFX_drawFastHLine(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t w,
 /**************************************************************************/
 void GFX_fillRect(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t w, int16_t h,
                   uint16_t color) {
-  for (int16_t i = x; i < x + w; i++) {
-    GFX_drawFastVLine(gfx, i, y, h, color);
+  if (!GFX_binBegin(gfx)) return;
+  // columns x .. x + w - 1 as vertical lines, nothing if w is 0 or less
+  if (w > 0) {
+    GFX_lineSpan(&y, &h);
+    GFX_fillSpanRect(gfx, x, y, w, h, color);
   }
+  GFX_binEnd(gfx);
 }
 
 /**************************************************************************/
@@ -298,7 +618,7 @@ void GFX_fillRect(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t w, int16_t h,
 */
 /**************************************************************************/
 void GFX_fillScreen(Adafruit_GFX *gfx, uint16_t color) {
-  uint32_t size = ((gfx->WIDTH + 7) / 8) * gfx->page_height;
+  uint32_t size = gfx->stride * gfx->page_height;
   memset(gfx->buffer, color == GFX_WHITE ? 0xFF : 0x00, size);
   if (gfx->color != NULL)
     memset(gfx->color, color == GFX_RED ? 0x00 : 0xFF, size);
@@ -315,16 +635,21 @@ void GFX_fillScreen(Adafruit_GFX *gfx, uint16_t color) {
 /**************************************************************************/
 void GFX_drawCircle(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t r,
                     uint16_t color) {
+  if (!GFX_binBegin(gfx)) return;
+  if (GFX_outsideWindow(gfx, x0 - ABS(r), y0 - ABS(r), x0 + ABS(r), y0 + ABS(r))) {
+    GFX_binEnd(gfx);
+    return;
+  }
   int16_t f = 1 - r;
   int16_t ddF_x = 1;
   int16_t ddF_y = -2 * r;
   int16_t x = 0;
   int16_t y = r;
 
-  GFX_drawPixel(gfx, x0, y0 + r, color);
-  GFX_drawPixel(gfx, x0, y0 - r, color);
-  GFX_drawPixel(gfx, x0 + r, y0, color);
-  GFX_drawPixel(gfx, x0 - r, y0, color);
+  gfx->write_pixel(gfx, x0, y0 + r, color);
+  gfx->write_pixel(gfx, x0, y0 - r, color);
+  gfx->write_pixel(gfx, x0 + r, y0, color);
+  gfx->write_pixel(gfx, x0 - r, y0, color);
 
   while (x < y) {
     if (f >= 0) {
@@ -336,15 +661,16 @@ void GFX_drawCircle(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t r,
     ddF_x += 2;
     f += ddF_x;
 
-    GFX_drawPixel(gfx, x0 + x, y0 + y, color);
-    GFX_drawPixel(gfx, x0 - x, y0 + y, color);
-    GFX_drawPixel(gfx, x0 + x, y0 - y, color);
-    GFX_drawPixel(gfx, x0 - x, y0 - y, color);
-    GFX_drawPixel(gfx, x0 + y, y0 + x, color);
-    GFX_drawPixel(gfx, x0 - y, y0 + x, color);
-    GFX_drawPixel(gfx, x0 + y, y0 - x, color);
-    GFX_drawPixel(gfx, x0 - y, y0 - x, color);
+    gfx->write_pixel(gfx, x0 + x, y0 + y, color);
+    gfx->write_pixel(gfx, x0 - x, y0 + y, color);
+    gfx->write_pixel(gfx, x0 + x, y0 - y, color);
+    gfx->write_pixel(gfx, x0 - x, y0 - y, color);
+    gfx->write_pixel(gfx, x0 + y, y0 + x, color);
+    gfx->write_pixel(gfx, x0 - y, y0 + x, color);
+    gfx->write_pixel(gfx, x0 + y, y0 - x, color);
+    gfx->write_pixel(gfx, x0 - y, y0 - x, color);
   }
+  GFX_binEnd(gfx);
 }
 
 /**************************************************************************/
@@ -360,6 +686,12 @@ void GFX_drawCircle(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t r,
 /**************************************************************************/
 void GFX_drawCircleHelper(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t r,
                           uint8_t cornername, uint16_t color) {
+  if (!GFX_binBegin(gfx)) return;
+  if (GFX_outsideWindow(gfx, cornername & 0x9 ? x0 - r : x0, cornername & 0x3 ? y0 - r : y0,
+                        cornername & 0x6 ? x0 + r : x0, cornername & 0xC ? y0 + r : y0)) {
+    GFX_binEnd(gfx);
+    return;
+  }
   int16_t f = 1 - r;
   int16_t ddF_x = 1;
   int16_t ddF_y = -2 * r;
@@ -376,22 +708,23 @@ void GFX_drawCircleHelper(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t r,
     ddF_x += 2;
     f += ddF_x;
     if (cornername & 0x4) {
-      GFX_drawPixel(gfx, x0 + x, y0 + y, color);
-      GFX_drawPixel(gfx, x0 + y, y0 + x, color);
+      gfx->write_pixel(gfx, x0 + x, y0 + y, color);
+      gfx->write_pixel(gfx, x0 + y, y0 + x, color);
     }
     if (cornername & 0x2) {
-      GFX_drawPixel(gfx, x0 + x, y0 - y, color);
-      GFX_drawPixel(gfx, x0 + y, y0 - x, color);
+      gfx->write_pixel(gfx, x0 + x, y0 - y, color);
+      gfx->write_pixel(gfx, x0 + y, y0 - x, color);
     }
     if (cornername & 0x8) {
-      GFX_drawPixel(gfx, x0 - y, y0 + x, color);
-      GFX_drawPixel(gfx, x0 - x, y0 + y, color);
+      gfx->write_pixel(gfx, x0 - y, y0 + x, color);
+      gfx->write_pixel(gfx, x0 - x, y0 + y, color);
     }
     if (cornername & 0x1) {
-      GFX_drawPixel(gfx, x0 - y, y0 - x, color);
-      GFX_drawPixel(gfx, x0 - x, y0 - y, color);
+      gfx->write_pixel(gfx, x0 - y, y0 - x, color);
+      gfx->write_pixel(gfx, x0 - x, y0 - y, color);
     }
   }
+  GFX_binEnd(gfx);
 }
 
 /**************************************************************************/
@@ -405,8 +738,10 @@ void GFX_drawCircleHelper(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t r,
 /**************************************************************************/
 void GFX_fillCircle(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t r,
                     uint16_t color) {
+  if (!GFX_binBegin(gfx)) return;
   GFX_drawFastVLine(gfx, x0, y0 - r, 2 * r + 1, color);
   GFX_fillCircleHelper(gfx, x0, y0, r, 3, 0, color);
+  GFX_binEnd(gfx);
 }
 
 /**************************************************************************/
@@ -422,6 +757,12 @@ void GFX_fillCircle(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t r,
 /**************************************************************************/
 void GFX_fillCircleHelper(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t r,
                           uint8_t corners, int16_t delta, uint16_t color) {
+  if (!GFX_binBegin(gfx)) return;
+  if (GFX_outsideWindow(gfx, corners & 2 ? x0 - r : x0, y0 - r + MIN(delta, 0),
+                        corners & 1 ? x0 + r : x0, y0 + r + MAX(delta, 0))) {
+    GFX_binEnd(gfx);
+    return;
+  }
 
   int16_t f = 1 - r;
   int16_t ddF_x = 1;
@@ -459,6 +800,7 @@ void GFX_fillCircleHelper(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t r,
     }
     px = x;
   }
+  GFX_binEnd(gfx);
 }
 
 /**************************************************************************/
@@ -473,10 +815,12 @@ void GFX_fillCircleHelper(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t r,
 /**************************************************************************/
 void GFX_drawRect(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t w, int16_t h,
                   uint16_t color) {
+  if (!GFX_binBegin(gfx)) return;
   GFX_drawFastHLine(gfx, x, y, w, color);
   GFX_drawFastHLine(gfx, x, y + h - 1, w, color);
   GFX_drawFastVLine(gfx, x, y, h, color);
   GFX_drawFastVLine(gfx, x + w - 1, y, h, color);
+  GFX_binEnd(gfx);
 }
 
 /**************************************************************************/
@@ -492,6 +836,7 @@ void GFX_drawRect(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t w, int16_t h,
 /**************************************************************************/
 void GFX_drawRoundRect(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t w,
                        int16_t h, int16_t r, uint16_t color) {
+  if (!GFX_binBegin(gfx)) return;
   int16_t max_radius = ((w < h) ? w : h) / 2; // 1/2 minor axis
   if (r > max_radius)
     r = max_radius;
@@ -505,6 +850,7 @@ void GFX_drawRoundRect(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t w,
   GFX_drawCircleHelper(gfx, x + w - r - 1, y + r, r, 2, color);
   GFX_drawCircleHelper(gfx, x + w - r - 1, y + h - r - 1, r, 4, color);
   GFX_drawCircleHelper(gfx, x + r, y + h - r - 1, r, 8, color);
+  GFX_binEnd(gfx);
 }
 
 /**************************************************************************/
@@ -520,6 +866,7 @@ void GFX_drawRoundRect(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t w,
 /**************************************************************************/
 void GFX_fillRoundRect(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t w,
                        int16_t h, int16_t r, uint16_t color) {
+  if (!GFX_binBegin(gfx)) return;
   int16_t max_radius = ((w < h) ? w : h) / 2; // 1/2 minor axis
   if (r > max_radius)
     r = max_radius;
@@ -528,6 +875,7 @@ void GFX_fillRoundRect(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t w,
   // draw four corners
   GFX_fillCircleHelper(gfx, x + w - r - 1, y + r, r, 1, h - 2 * r - 1, color);
   GFX_fillCircleHelper(gfx, x + r, y + r, r, 2, h - 2 * r - 1, color);
+  GFX_binEnd(gfx);
 }
 
 /**************************************************************************/
@@ -544,9 +892,11 @@ void GFX_fillRoundRect(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t w,
 /**************************************************************************/
 void GFX_drawTriangle(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t x1,
                       int16_t y1, int16_t x2, int16_t y2, uint16_t color) {
+  if (!GFX_binBegin(gfx)) return;
   GFX_drawLine(gfx, x0, y0, x1, y1, color);
   GFX_drawLine(gfx, x1, y1, x2, y2, color);
   GFX_drawLine(gfx, x2, y2, x0, y0, color);
+  GFX_binEnd(gfx);
 }
 
 /**************************************************************************/
@@ -563,6 +913,7 @@ void GFX_drawTriangle(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t x1,
 /**************************************************************************/
 void GFX_fillTriangle(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t x1,
                       int16_t y1, int16_t x2, int16_t y2, uint16_t color) {
+  if (!GFX_binBegin(gfx)) return;
 
   int16_t a, b, y, last;
 
@@ -580,6 +931,15 @@ void GFX_fillTriangle(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t x1,
     SWAP(x0, x1, int16_t);
   }
 
+  // only the scanlines inside the page are walked
+  int16_t win[4];
+  GFX_getWindow(gfx, win);
+  if (y2 < win[1] || y0 > win[3] || MAX(MAX(x0, x1), x2) < win[0] ||
+      MIN(MIN(x0, x1), x2) > win[2]) {
+    GFX_binEnd(gfx);
+    return;
+  }
+
   if (y0 == y2) { // Handle awkward all-on-same-line case as its own thing
     a = b = x0;
     if (x1 < a)
@@ -591,6 +951,7 @@ void GFX_fillTriangle(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t x1,
     else if (x2 > b)
       b = x2;
     GFX_drawFastHLine(gfx, a, y0, b - a + 1, color);
+    GFX_binEnd(gfx);
     return;
   }
 
@@ -609,7 +970,10 @@ void GFX_fillTriangle(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t x1,
   else
     last = y1 - 1; // Skip it
 
-  for (y = y0; y <= last; y++) {
+  y = MAX(y0, win[1]);
+  sa = (int32_t)dx01 * (y - y0);
+  sb = (int32_t)dx02 * (y - y0);
+  for (; y <= MIN(last, win[3]); y++) {
     a = x0 + sa / dy01;
     b = x0 + sb / dy02;
     sa += dx01;
@@ -625,9 +989,10 @@ void GFX_fillTriangle(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t x1,
 
   // For lower part of triangle, find scanline crossings for segments
   // 0-2 and 1-2.  This loop is skipped if y1=y2.
+  y = MAX(last + 1, win[1]);
   sa = (int32_t)dx12 * (y - y1);
   sb = (int32_t)dx02 * (y - y0);
-  for (; y <= y2; y++) {
+  for (; y <= MIN(y2, win[3]); y++) {
     a = x1 + sa / dy12;
     b = x0 + sb / dy02;
     sa += dx12;
@@ -640,6 +1005,7 @@ void GFX_fillTriangle(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t x1,
       SWAP(a, b, int16_t);
     GFX_drawFastHLine(gfx, a, y, b - a + 1, color);
   }
+  GFX_binEnd(gfx);
 }
 
 /**************************************************************************/
@@ -657,20 +1023,28 @@ void GFX_fillTriangle(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t x1,
 /**************************************************************************/
 void GFX_drawBitmap(Adafruit_GFX *gfx, int16_t x, int16_t y, const uint8_t bitmap[],
                     int16_t w, int16_t h, uint16_t color, bool invert) {
+  if (!GFX_binBegin(gfx)) return;
 
   int16_t byteWidth = (w + 7) / 8; // Bitmap scanline pad = whole byte
   uint8_t byte = 0;
 
-  for (int16_t j = 0; j < h; j++) {
-    for (int16_t i = 0; i < w; i++) {
-      if (i & 7)
+  // only the rows and columns inside the page are read
+  int16_t win[4];
+  GFX_getWindow(gfx, win);
+  int16_t i0 = MAX(win[0] - x, 0), i1 = MIN(win[2] - x + 1, w);
+  int16_t j0 = MAX(win[1] - y, 0), j1 = MIN(win[3] - y + 1, h);
+
+  for (int16_t j = j0; j < j1; j++) {
+    for (int16_t i = i0; i < i1; i++) {
+      if ((i & 7) && i > i0)
         byte <<= 1;
       else
-        byte = bitmap[j * byteWidth + i / 8];
+        byte = bitmap[j * byteWidth + i / 8] << (i & 7);
       if (((byte & 0x80) == 0x80) ^ invert)
-        GFX_drawPixel(gfx, x + i, y + j, color);
+        gfx->write_pixel(gfx, x + i, y + j, color);
     }
   }
+  GFX_binEnd(gfx);
 }
 
 /*
@@ -742,11 +1116,38 @@ int8_t GFX_getFontDescent(Adafruit_GFX *gfx) {
 }
 
 int16_t GFX_drawGlyph(Adafruit_GFX *gfx, int16_t x, int16_t y, uint16_t e) {
-  return u8g2_DrawGlyph(&gfx->u8g2, x, y, e);
+  if (!GFX_binBegin(gfx)) return u8g2_GetGlyphWidth(&gfx->u8g2, e); // advance only
+  int16_t delta = u8g2_DrawGlyph(&gfx->u8g2, x, y, e);
+  GFX_binEnd(gfx);
+  return delta;
 }
 
 int16_t GFX_drawStr(Adafruit_GFX *gfx, int16_t x, int16_t y, const char *s) {
-  return u8g2_DrawStr(&gfx->u8g2, x, y, s);
+  int16_t sum, delta;
+  sum = 0;
+
+  while( *s != '\0' )
+  {
+    delta = GFX_drawGlyph(gfx, x, y, *s);
+    switch(gfx->u8g2.font_decode.dir)
+    {
+      case 0:
+        x += delta;
+        break;
+      case 1:
+        y += delta;
+        break;
+      case 2:
+        x -= delta;
+        break;
+      case 3:
+        y -= delta;
+        break;
+    }
+    sum += delta;
+    s++;
+  }
+  return sum;
 }
 
 static uint16_t utf8_next(Adafruit_GFX *gfx, uint8_t b)
@@ -816,7 +1217,7 @@ int16_t GFX_drawUTF8(Adafruit_GFX *gfx, int16_t x, int16_t y, const char *str)
     str++;
     if ( e != 0x0fffe )
     {
-      delta = u8g2_DrawGlyph(&gfx->u8g2, x, y, e);
+      delta = GFX_drawGlyph(gfx, x, y, e);
     
       switch(gfx->u8g2.font_decode.dir)
       {
@@ -887,7 +1288,7 @@ size_t GFX_print(Adafruit_GFX *gfx, const char c) {
   }
   else if ( e < 0x0fffe )
   {
-    delta = u8g2_DrawGlyph(&gfx->u8g2, gfx->tx, gfx->ty, e);
+    delta = GFX_drawGlyph(gfx, gfx->tx, gfx->ty, e);
     switch(gfx->u8g2.font_decode.dir)
     {
       case 0:
@@ -920,11 +1321,15 @@ size_t GFX_printf(Adafruit_GFX *gfx, const char* format, ...) {
   va_list va;
   char tmp[64] = {0};
   char *buf = tmp;
-  size_t len;
+  size_t len, cnt;
+  int n;
  
   va_start(va, format);
-  len = vsnprintf(tmp, sizeof(tmp), format, va);
+  n = vsnprintf(tmp, sizeof(tmp), format, va);
   va_end(va);
+  if (n < 0)
+    return 0;
+  len = n;
 
   if (len > sizeof(tmp) - 1)
   {
@@ -936,5 +1341,8 @@ size_t GFX_printf(Adafruit_GFX *gfx, const char* format, ...) {
     va_end(va);
   }
  
-  return GFX_write(gfx, buf, len);
+  cnt = GFX_write(gfx, buf, len);
+  if (buf != tmp)
+    free(buf);
+  return cnt;
 }
@@ -20,7 +20,7 @@ typedef enum {
 } GFX_Rotate;
 
 // GRAPHICS CONTEXT
-typedef struct {
+typedef struct _Adafruit_GFX {
   int16_t WIDTH;        ///< This is the 'raw' display width - never changes
   int16_t HEIGHT;       ///< This is the 'raw' display height - never changes
   int16_t _width;       ///< Display width as modified by current rotation
@@ -34,18 +34,32 @@ typedef struct {
 
   uint8_t *buffer;      // black pixel buffer
   uint8_t *color;       // color pixel buffer
+  uint16_t stride;      // bytes per buffer row
   int16_t page_height;
   int16_t current_page;
   int16_t total_pages;
+  int16_t page_y;       // first buffer row of the current page
+
+  // pixel writer for the rotation and color mode, bound by GFX_begin and GFX_setRotation
+  void (*write_pixel)(struct _Adafruit_GFX *gfx, int16_t x, int16_t y, uint16_t color);
+
+  uint8_t *bins;        // pages touched by each primitive (first << 4 | last), recorded on the first page
+  uint16_t bins_size;   // number of primitives bins can hold
+  uint16_t bin;         // index of the primitive being drawn
+  uint8_t bin_depth;    // nesting of draw calls, only the outermost one is a primitive
+  bool bin_record;      // recording the pages touched by the current primitive
+  uint8_t bin_first;    // first page touched by the current primitive
+  uint8_t bin_last;     // last page touched by the current primitive
 } Adafruit_GFX;
 
 // CONTROL API
-void GFX_begin(Adafruit_GFX *gfx, int16_t w, int16_t h, int16_t buffer_height);
-void GFX_begin_3c(Adafruit_GFX *gfx, int16_t w, int16_t h, int16_t buffer_height);
+bool GFX_begin(Adafruit_GFX *gfx, int16_t w, int16_t h, uint8_t *buffer, uint32_t size);
+bool GFX_begin_3c(Adafruit_GFX *gfx, int16_t w, int16_t h, uint8_t *buffer, uint32_t size);
 void GFX_setRotation(Adafruit_GFX *gfx, GFX_Rotate r);
 void GFX_firstPage(Adafruit_GFX *gfx);
 bool GFX_nextPage(Adafruit_GFX *gfx, buffer_callback callback);
 void GFX_end(Adafruit_GFX *gfx);
+void GFX_setPageBins(Adafruit_GFX *gfx, uint8_t *bins, uint16_t size);
 
 // DRAW API
 void GFX_drawPixel(Adafruit_GFX *gfx, int16_t x, int16_t y, uint16_t color);
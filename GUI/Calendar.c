@@ -6,7 +6,17 @@
 #define NRF_LOG_MODULE_NAME "Calendar"
 #include "nrf_log.h"
 
-#define PAGE_HEIGHT 72
+/**
+ * Page buffer, the page height follows from its size: 72 rows black/white
+ * or 36 rows black/red by default. Parts with 32K RAM can raise it to a
+ * full frame (400x300: 15000 bytes, 30000 with red) and render in one pass.
+**/
+#ifndef CALENDAR_BUFFER_SIZE
+#define CALENDAR_BUFFER_SIZE 3600
+#endif
+#define PAGE_BINS   256 // page ranges of the primitives, a month takes about 160
+
+static uint8_t m_buffer[CALENDAR_BUFFER_SIZE];
 
 static void DrawDateHeader(Adafruit_GFX *gfx, int16_t x, int16_t y, tm_t *tm, struct Lunar_Date *Lunar)
 {
@@ -83,11 +93,19 @@ void DrawCalendar(uint32_t timestamp)
     uint8_t monthMaxDays = thisMonthMaxDays(tm.tm_year + YEAR0, tm.tm_mon + 1);
 
     Adafruit_GFX gfx;
+    uint8_t bins[PAGE_BINS];
 
-    if (driver->id == EPD_DRIVER_4IN2B_V2)
-      GFX_begin_3c(&gfx, driver->width, driver->height, PAGE_HEIGHT);
+    bool ok;
+    if (driver->caps.planes > 1)
+      ok = GFX_begin_3c(&gfx, driver->width, driver->height, m_buffer, sizeof(m_buffer));
     else
-      GFX_begin(&gfx, driver->width, driver->height, PAGE_HEIGHT);
+      ok = GFX_begin(&gfx, driver->width, driver->height, m_buffer, sizeof(m_buffer));
+    if (!ok)
+    {
+        NRF_LOG_ERROR("page buffer holds no row of %d pixels\n", driver->width);
+        return;
+    }
+    GFX_setPageBins(&gfx, bins, sizeof(bins));
 
     GFX_firstPage(&gfx);
     do {
@@ -102,8 +120,4 @@ void DrawCalendar(uint32_t timestamp)
     } while(GFX_nextPage(&gfx, driver->write_image));
 
     GFX_end(&gfx);
-
-    NRF_LOG_DEBUG("display start\n");
-    driver->refresh();
-    NRF_LOG_DEBUG("display end\n");
 }
@@ -3,6 +3,16 @@ let gattServer;
 let epdService;
 let epdCharacteristic;
 let reconnectTrys = 0;
+let credits = 0;
+let creditWaiter = null;
+let deviceMac = null;
+let deviceFrame = 0;
+let deviceDriver = null;
+let imageNack = null;
+let imageStatus = null;
+let frameOffset = null;
+let pendingFrame = null;
+let notifyWaiter = null;
 
 let canvas;
 let startTime;
@@ -16,6 +26,13 @@ const EpdCmd = {
   SEND_DATA: 0x04,
   DISPLAY:   0x05,
   SLEEP:     0x06,
+  BATCH:     0x07,
+
+  WRITE_IMAGE: 0x10,
+  SET_FRAME:   0x11,
+  IMAGE_DATA:  0x12,
+  FRAME_BEGIN:  0x13,
+  FRAME_COMMIT: 0x14,
 
   SET_TIME:  0x20,
 
@@ -25,13 +42,107 @@ const EpdCmd = {
   CFG_ERASE:  0x99,
 };
 
+const ImageEncoding = {
+  RAW:      0x00,
+  PACKBITS: 0x01,
+};
+
+const EpdNotify = {
+  CONFIG:  0x00,
+  CREDITS: 0x01,
+  FRAME:   0x02,
+  IMAGE_NACK:   0x03,
+  IMAGE_STATUS: 0x04,
+  FRAME_OFFSET: 0x05,
+  CONN_PARAMS:  0x06,
+  RX_OVERFLOW:  0x07,
+  STATUS:       0x08,
+  DRIVER:       0x09,
+  UNCHANGED:    0x0a,
+};
+
+const DriverCaps = {
+  PARTIAL:     0x01,
+  TEMPERATURE: 0x02,
+  WAVEFORM:    0x04,
+};
+
+const EpdStateText = ['空闲', '接收中', '刷新中', '睡眠'];
+const EpdErrorText = ['无', '接收队列溢出', '图像窗口无效', '图像校验失败', '画面提交被拒绝', '画面校验失败', '图像不完整，拒绝刷新', '刷新超时'];
+
+const FRAME_WINDOW_ROWS = 24;
+
+const DisplayMode = {
+  FULL:    0x00,
+  PARTIAL: 0x01,
+  GREY:    0x02,
+};
+
+const ImageFlags = {
+  SEQUENCED: 0x01,
+};
+
+const ImageStatus = {
+  OK:         0x00,
+  CRC_ERROR:  0x01,
+  INCOMPLETE: 0x02,
+};
+
 function resetVariables() {
   gattServer = null;
   epdService = null;
   epdCharacteristic = null;
+  deviceFrame = 0;
+  deviceDriver = null;
+  resetCredits();
   document.getElementById("log").value = '';
 }
 
+function resetCredits() {
+  credits = 0;
+  if (creditWaiter) creditWaiter(false);
+  creditWaiter = null;
+  if (notifyWaiter) notifyWaiter(false);
+  notifyWaiter = null;
+}
+
+function addCredits(count) {
+  credits += count;
+  if (creditWaiter && credits > 0) {
+    credits--;
+    creditWaiter(true);
+    creditWaiter = null;
+  }
+}
+
+// every packet takes one slot of the device receive queue
+function takeCredit() {
+  if (credits > 0) {
+    credits--;
+    return Promise.resolve(true);
+  }
+  return new Promise((resolve) => {
+    creditWaiter = resolve;
+  });
+}
+
+function wakeWaiter() {
+  if (notifyWaiter) notifyWaiter(true);
+  notifyWaiter = null;
+}
+
+// resolves true once ready() holds after a notification, false on timeout or disconnect
+function waitNotify(ready, timeout) {
+  if (ready()) return Promise.resolve(true);
+  return new Promise((resolve) => {
+    const timer = setTimeout(() => { notifyWaiter = null; resolve(false); }, timeout);
+    notifyWaiter = async (result) => {
+      clearTimeout(timer);
+      resolve(result && (ready() || await waitNotify(ready, timeout)));
+    };
+  });
+}
+
 async function handleError(error) {
   console.error(error);
   resetVariables();
@@ -52,7 +163,7 @@ async function write(cmd, data, withResponse=true) {
     addLog("服务不可用，请检查蓝牙连接");
     return false;
   }
-  let payload = [cmd];
+  let payload = cmd == null ? [] : [cmd];
   if (data) {
     if (typeof data == 'string') data = hex2bytes(data);
     if (data instanceof Uint8Array) data = Array.from(data);
@@ -62,6 +173,7 @@ async function write(cmd, data, withResponse=true) {
     addLog("BLE packet too large!");
     return false;
   }
+  if (!await takeCredit()) return false;
   addLog(`<span class="action">⇑</span> ${bytes2hex(payload)}`);
   try {
     if (withResponse)
@@ -76,33 +188,102 @@ async function write(cmd, data, withResponse=true) {
   return true;
 }
 
-async function epdWrite(cmd, data) {
-  const chunkSize = MAX_PACKET_SIZE - 1;
-  const count = Math.round(data.length / chunkSize);
-  const interleavedCount = document.getElementById('interleavedcount').value;
-  let chunkIdx = 0;
-  let noReplyCount = interleavedCount;
+// pack commands ([cmd, ...data]) into as few writes as possible: len(1) cmd(1) data ...
+async function writeBatch(cmds, withResponse=true) {
+  let batch = [];
+  let count = 0;
+  const flush = async () => {
+    if (count == 0) return true;
+    const ok = count == 1 ? await write(batch[1], batch.slice(2), withResponse)
+                          : await write(EpdCmd.BATCH, batch, withResponse);
+    batch = [];
+    count = 0;
+    return ok;
+  };
+
+  for (const cmd of cmds) {
+    if (1 + batch.length + 1 + cmd.length > MAX_PACKET_SIZE && !await flush()) return false;
+    batch.push(cmd.length, ...cmd);
+    count++;
+  }
+  return await flush();
+}
 
+async function epdWriteImage(plane, data, x=0, y=0, w=canvas.width, h=canvas.height, crcStart=0) {
   if (typeof data == 'string') data = hex2bytes(data);
 
-  await write(EpdCmd.SEND_CMD, [cmd]);
-  for (let i = 0; i < data.length; i += chunkSize) {
-    let currentTime = (new Date().getTime() - startTime) / 1000.0;
-    setStatus(`命令：0x${cmd.toString(16)}, 数据块: ${chunkIdx+1}/${count+1}, 总用时: ${currentTime}s`);
-    if (noReplyCount > 0) {
-      await write(EpdCmd.SEND_DATA, data.slice(i, i + chunkSize), false);
-      noReplyCount--;
-    } else {
-      await write(EpdCmd.SEND_DATA, data.slice(i, i + chunkSize), true);
-      noReplyCount = interleavedCount;
+  const crc = crc32(data, crcStart);
+  let encoding = ImageEncoding.RAW;
+  const packed = packbits(data);
+  if (packed.length < data.length) {
+    addLog(`图像压缩: ${data.length} → ${packed.length} 字节`);
+    encoding = ImageEncoding.PACKBITS;
+    data = packed;
+  }
+
+  const chunkSize = MAX_PACKET_SIZE - 2;
+  const count = Math.ceil(data.length / chunkSize);
+
+  for (let attempt = 0; attempt < 3; attempt++) {
+    imageNack = null;
+    imageStatus = null;
+    if (!await write(EpdCmd.WRITE_IMAGE, [plane, ...u16ToBytes(x), ...u16ToBytes(y), ...u16ToBytes(w),
+                                          ...u16ToBytes(h), ...u16ToBytes(data.length), encoding,
+                                          ImageFlags.SEQUENCED, ...u32ToBytes(crc)]))
+      return false;
+
+    // go-back-N: on a NACK, resend everything from the expected sequence number
+    let chunkIdx = 0;
+    let timeouts = 0;
+    while (imageStatus === null) {
+      if (imageNack !== null) {
+        chunkIdx -= (chunkIdx - imageNack) & 0xFF;
+        imageNack = null;
+      }
+      if (chunkIdx < count) {
+        const chunk = data.slice(chunkIdx * chunkSize, (chunkIdx + 1) * chunkSize);
+        if (!await write(EpdCmd.IMAGE_DATA, [chunkIdx & 0xFF, ...chunk], false)) return false;
+        chunkIdx++;
+      } else if (!await waitNotify(() => imageNack !== null || imageStatus !== null, 2000)) {
+        if (!epdCharacteristic || ++timeouts > 5) {
+          addLog('图像传输超时！');
+          return false;
+        }
+        await write(EpdCmd.IMAGE_DATA, [], false); // query the window state
+      }
     }
-    chunkIdx++;
+
+    if (imageStatus === ImageStatus.OK) return true;
+    addLog(`图像：0x${plane.toString(16)} 校验失败，重新发送`);
   }
+  return false;
+}
+
+// PackBits: header n < 128 copies n+1 literal bytes, n > 128 repeats the next byte 257-n times
+function packbits(data) {
+  const out = [];
+  let i = 0;
+  while (i < data.length) {
+    let run = 1;
+    while (i + run < data.length && run < 128 && data[i + run] === data[i]) run++;
+    if (run >= 2) {
+      out.push(257 - run, data[i]);
+      i += run;
+      continue;
+    }
+    let start = i;
+    while (i < data.length && i - start < 128 &&
+           !(i + 1 < data.length && data[i] === data[i + 1])) i++;
+    if (i === start) i++;
+    out.push(i - start - 1, ...data.slice(start, i));
+  }
+  return out;
 }
 
 async function setDriver() {
-  await write(EpdCmd.SET_PINS, document.getElementById("epdpins").value);
-  await write(EpdCmd.INIT, document.getElementById("epddriver").value);
+  deviceFrame = 0;                                    // INIT resets EPD ram
+  await writeBatch([[EpdCmd.SET_PINS, ...hex2bytes(document.getElementById("epdpins").value)],
+                    [EpdCmd.INIT, ...hex2bytes(document.getElementById("epddriver").value)]]);
 }
 
 async function syncTime() {
@@ -114,6 +295,7 @@ async function syncTime() {
     timestamp & 0xFF,
     -(new Date().getTimezoneOffset() / 60)
   ]);
+  deviceFrame = 0;                                    // the calendar draws over EPD ram
   if(await write(EpdCmd.SET_TIME, data)) {
     addLog("日历模式：时间已同步！需要一定时间刷新，请耐心等待。");
   }
@@ -121,6 +303,7 @@ async function syncTime() {
 
 async function clearScreen() {
   if(confirm('确认清除屏幕内容?')) {
+    deviceFrame = 0;
     await write(EpdCmd.CLEAR);
   }
 }
@@ -129,18 +312,10 @@ async function sendcmd() {
   const cmdTXT = document.getElementById('cmdTXT').value;
   if (cmdTXT == '') return;
   const bytes = hex2bytes(cmdTXT);
+  deviceFrame = 0;                                    // a raw command may overwrite EPD ram
   await write(bytes[0], bytes.length > 1 ? bytes.slice(1) : null);
 }
 
-async function send4GrayLut() {
-  await epdWrite(0x20, "000A0000000160141400000100140000000100130A010001000000000000000000000000000000000000"); // vcom
-  await epdWrite(0x21, "400A0000000190141400000110140A000001A01301000001000000000000000000000000000000000000"); // red not use
-  await epdWrite(0x22, "400A0000000190141400000100140A000001990C01030401000000000000000000000000000000000000"); // bw r
-  await epdWrite(0x23, "400A0000000190141400000100140A000001990B04040101000000000000000000000000000000000000"); // wb w
-  await epdWrite(0x24, "800A0000000190141400000120140A000001501301000001000000000000000000000000000000000000"); // bb b
-  await epdWrite(0x25, "400A0000000190141400000110140A000001A01301000001000000000000000000000000000000000000"); // vcom
-}
-
 function getImageData(canvas, driver, mode) {
   if (mode === '4gray') {
     return canvas2gray(canvas);
@@ -153,6 +328,124 @@ function getImageData(canvas, driver, mode) {
   }
 }
 
+// changed byte-aligned rectangles between two planes, rows closer than `gap` are merged
+function diffRects(prev, next, width, height, gap = 8) {
+  const stride = width / 8;
+  const rects = [];
+  let band = null;
+  for (let y = 0; y < height; y++) {
+    let first = -1, last = -1;
+    for (let x = 0; x < stride; x++) {
+      if (prev[y * stride + x] !== next[y * stride + x]) {
+        if (first < 0) first = x;
+        last = x;
+      }
+    }
+    if (first < 0) continue;
+    if (band && y - band.y1 <= gap) {
+      band.x0 = Math.min(band.x0, first);
+      band.x1 = Math.max(band.x1, last);
+      band.y1 = y;
+    } else {
+      if (band) rects.push(band);
+      band = { x0: first, x1: last, y0: y, y1: y };
+    }
+  }
+  if (band) rects.push(band);
+  return rects.map(r => ({ x: r.x0 * 8, y: r.y0, w: (r.x1 - r.x0 + 1) * 8, h: r.y1 - r.y0 + 1 }));
+}
+
+function cropPlane(data, width, rect) {
+  const stride = width / 8;
+  const out = [];
+  for (let y = rect.y; y < rect.y + rect.h; y++) {
+    const start = y * stride + rect.x / 8;
+    out.push(...data.slice(start, start + rect.w / 8));
+  }
+  return out;
+}
+
+// smallest rectangle covering both, a may be null
+function unionRect(a, b) {
+  if (!a) return { ...b };
+  const x = Math.min(a.x, b.x), y = Math.min(a.y, b.y);
+  return { x: x, y: y,
+           w: Math.max(a.x + a.w, b.x + b.w) - x,
+           h: Math.max(a.y + a.h, b.y + b.h) - y };
+}
+
+function loadFrame(key) {
+  try {
+    return JSON.parse(localStorage.getItem(key));
+  } catch (e) {
+    return null;
+  }
+}
+
+async function frameBegin(frame, size, crc) {
+  frameOffset = null;
+  if (!await write(EpdCmd.FRAME_BEGIN, [...u32ToBytes(frame.id), ...u32ToBytes(size), ...u32ToBytes(crc)]))
+    return null;
+  if (!await waitNotify(() => frameOffset !== null, 5000) || frameOffset.id !== frame.id)
+    return null;
+  return frameOffset.offset;
+}
+
+// upload a full frame as a transaction, resuming from the offset the device acknowledged
+async function uploadFrame(frame, resume=false) {
+  const all = frame.planes.flatMap(p => Array.from(p.data));
+  const crc = crc32(all);
+  const stride = frame.width / 8;
+  const planeSize = stride * frame.height;
+
+  let offset = await frameBegin(frame, all.length, crc);
+  if (offset === null) return false;
+  if (resume && offset === 0) {
+    // the transaction is gone, so is EPD ram
+    await write(EpdCmd.INIT);
+    offset = await frameBegin(frame, all.length, crc);
+    if (offset === null) return false;
+  }
+  if (offset > 0) addLog(`从 ${offset} 字节处继续发送`);
+
+  let crcAcc = crc32(all.slice(0, offset));
+  while (offset < all.length) {
+    const y = (offset % planeSize) / stride;
+    const h = Math.min(FRAME_WINDOW_ROWS, frame.height - y);
+    const chunk = all.slice(offset, offset + h * stride);
+    const plane = frame.planes[Math.floor(offset / planeSize)];
+    if (!await epdWriteImage(plane.cmd, chunk, 0, y, frame.width, h, crcAcc)) return false;
+    crcAcc = crc32(chunk, crcAcc);
+    offset += chunk.length;
+  }
+
+  frameOffset = null;
+  deviceFrame = 0;
+  const displayMode = frame.mode === "4gray" ? DisplayMode.GREY : DisplayMode.FULL;
+  if (!await write(EpdCmd.FRAME_COMMIT, [...u32ToBytes(frame.id), displayMode])) return false;
+  return await waitNotify(() => deviceFrame === frame.id || frameOffset !== null, 30000) && deviceFrame === frame.id;
+}
+
+function saveFrame(frame) {
+  if (!frame.key) return;
+  localStorage.setItem(frame.key, JSON.stringify({
+    token: frame.id, width: frame.width, height: frame.height,
+    planes: frame.planes.map(p => ({ cmd: p.cmd, data: bytes2hex(p.data) }))
+  }));
+}
+
+async function sendFrame(frame, resume=false) {
+  if (!await uploadFrame(frame, resume)) {
+    addLog('发送中断，重连后将继续发送');
+    return;
+  }
+  pendingFrame = null;
+  saveFrame(frame);
+
+  const sendTime = (new Date().getTime() - startTime) / 1000.0;
+  addLog(`发送完成！耗时: ${sendTime}s`);
+}
+
 async function sendimg() {
   startTime = new Date().getTime();
   const canvas = document.getElementById("canvas");
@@ -166,25 +459,66 @@ async function sendimg() {
     return;
   }
 
+  let planes;
   if (imgArray.length == ramSize * 2) {
-    await epdWrite(0x10, imgArray.slice(0, ramSize));
-    await epdWrite(0x13, imgArray.slice(ramSize));
+    planes = [{ cmd: 0x10, data: imgArray.slice(0, ramSize) },
+              { cmd: 0x13, data: imgArray.slice(ramSize) }];
   } else {
-    await epdWrite(driver === "03" ? 0x10 : 0x13, imgArray);
+    const cmd = deviceDriver ? deviceDriver.blackCmd : (driver === "03" ? 0x10 : 0x13);
+    planes = [{ cmd: cmd, data: imgArray }];
+  }
+
+  const frame = {
+    id: (Math.random() * 0xFFFFFFFE + 1) >>> 0,
+    key: deviceMac ? `epd-frame-${deviceMac}` : null,
+    width: canvas.width, height: canvas.height,
+    mode: mode, planes: planes
+  };
+
+  // only send what changed since the last frame, if it is still in EPD ram
+  const last = frame.key ? loadFrame(frame.key) : null;
+  const delta = last && deviceFrame !== 0 && last.token === deviceFrame &&
+                last.width === canvas.width && last.height === canvas.height &&
+                last.planes.length === planes.length &&
+                last.planes.every((p, i) => p.cmd === planes[i].cmd);
+
+  if (!delta) {
+    pendingFrame = frame;
+    await sendFrame(frame);
+    return;
+  }
+
+  let bounds = null;
+  for (let i = 0; i < planes.length; i++) {
+    const plane = planes[i];
+    const rects = diffRects(hex2bytes(last.planes[i].data), plane.data, canvas.width, canvas.height);
+    addLog(`图像：0x${plane.cmd.toString(16)}, 变化区域: ${rects.length}`);
+    for (const rect of rects) {
+      bounds = unionRect(bounds, rect);
+      if (!await epdWriteImage(plane.cmd, cropPlane(plane.data, canvas.width, rect), rect.x, rect.y, rect.w, rect.h)) {
+        addLog('发送失败！');
+        return;
+      }
+    }
   }
 
   if (mode === "4gray") {
-    await epdWrite(0x00, [0x3F]); // Load LUT from register
-    await send4GrayLut();
-    await write(EpdCmd.DISPLAY);
-    await epdWrite(0x00, [0x1F]); // Load LUT from OTP
+    await write(EpdCmd.DISPLAY, [DisplayMode.GREY]); // grey LUT is kept in firmware
+  } else if (bounds && deviceDriver && (deviceDriver.flags & DriverCaps.PARTIAL)) {
+    // fast refresh of the changed area, the device falls back to a full refresh when one is due
+    await write(EpdCmd.DISPLAY, [DisplayMode.PARTIAL, ...u16ToBytes(bounds.x), ...u16ToBytes(bounds.y),
+                                 ...u16ToBytes(bounds.w), ...u16ToBytes(bounds.h)]);
   } else {
     await write(EpdCmd.DISPLAY);
   }
 
+  if (await write(EpdCmd.SET_FRAME, u32ToBytes(frame.id))) {
+    deviceFrame = frame.id;
+    saveFrame(frame);
+  }
+
   const sendTime = (new Date().getTime() - startTime) / 1000.0;
   addLog(`发送完成！耗时: ${sendTime}s`);
-  setStatus(`发送完成！耗时: ${sendTime}s`);
 }
 
 function updateButtonStatus() {
@@ -255,18 +589,81 @@ async function connect() {
     epdCharacteristic = await epdService.getCharacteristic('62750002-d828-918d-fb46-b6c11c675aec');
     addLog('  找到 Characteristic');
 
-    await epdCharacteristic.startNotifications();
     epdCharacteristic.addEventListener('characteristicvaluechanged', (event) => {
-      addLog(`<span class="action">⇓</span> ${bytes2hex(event.target.value.buffer)}`);
-      document.getElementById("epdpins").value = bytes2hex(event.target.value.buffer.slice(0, 7));
-      document.getElementById("epddriver").value = bytes2hex(event.target.value.buffer.slice(7, 8));
-      filterDitheringOptions();
+      const buffer = event.target.value.buffer;
+      const data = new Uint8Array(buffer);
+      switch (data[0]) {
+        case EpdNotify.CONFIG:
+          addLog(`<span class="action">⇓</span> ${bytes2hex(buffer)}`);
+          document.getElementById("epdpins").value = bytes2hex(buffer.slice(1, 8));
+          document.getElementById("epddriver").value = bytes2hex(buffer.slice(8, 9));
+          filterDitheringOptions();
+          break;
+        case EpdNotify.CREDITS:
+          addCredits(data[1]);
+          break;
+        case EpdNotify.FRAME:
+          addLog(`<span class="action">⇓</span> ${bytes2hex(buffer)}`);
+          deviceMac = bytes2hex(buffer.slice(1, 7));
+          deviceFrame = new DataView(buffer).getUint32(7);
+          wakeWaiter();
+          break;
+        case EpdNotify.IMAGE_NACK:
+          imageNack = data[1];
+          wakeWaiter();
+          break;
+        case EpdNotify.IMAGE_STATUS:
+          imageStatus = data[1];
+          wakeWaiter();
+          break;
+        case EpdNotify.CONN_PARAMS: {
+          const view = new DataView(buffer);
+          addLog(`连接参数: 间隔 ${view.getUint16(1) * 1.25}ms, 延迟 ${view.getUint16(3)}, 超时 ${view.getUint16(5) * 10}ms`);
+          break;
+        }
+        case EpdNotify.RX_OVERFLOW:
+          addLog(`设备接收队列已满，已丢弃 ${new DataView(buffer).getUint16(1)} 个数据包`);
+          break;
+        case EpdNotify.DRIVER: {
+          const view = new DataView(buffer);
+          deviceDriver = {
+            id: data[1], width: view.getUint16(2), height: view.getUint16(4),
+            planes: data[6], greyLevels: data[7], lutSlots: data[8],
+            blackCmd: data[9], colorCmd: data[10], flags: data[11]
+          };
+          addLog(`驱动: ${bytes2hex(buffer.slice(1, 2))}, ${deviceDriver.width}x${deviceDriver.height}, ` +
+                 `颜色平面: ${deviceDriver.planes}, 灰阶: ${deviceDriver.greyLevels}`);
+          break;
+        }
+        case EpdNotify.UNCHANGED:
+          addLog(`画面未变化，跳过刷新 (指纹: ${bytes2hex(buffer.slice(1, 5))})`);
+          break;
+        case EpdNotify.STATUS: {
+          const view = new DataView(buffer);
+          setStatus(`状态: ${EpdStateText[data[1]] ?? data[1]}, 队列: ${data[3]}, 已接收: ${view.getUint32(4)} 字节, ` +
+                    `上次刷新: ${view.getUint16(8)}ms, 温度: ${view.getInt8(10) === -128 ? '未知' : view.getInt8(10) + '℃'}, ` +
+                    `波形: ${data[11] === 0xFF ? '上位机' : data[11]}, 错误: ${EpdErrorText[data[2]] ?? data[2]}`);
+          break;
+        }
+        case EpdNotify.FRAME_OFFSET:
+          addLog(`<span class="action">⇓</span> ${bytes2hex(buffer)}`);
+          frameOffset = { id: new DataView(buffer).getUint32(1), offset: new DataView(buffer).getUint32(5) };
+          wakeWaiter();
+          break;
+      }
     });
-
-    await write(EpdCmd.INIT);
+    resetCredits();
+    await epdCharacteristic.startNotifications();
 
     document.getElementById("connectbutton").innerHTML = '断开';
     updateButtonStatus();
+
+    if (pendingFrame) {
+      addLog('继续发送未完成的画面');
+      await sendFrame(pendingFrame, true);
+    } else {
+      await write(EpdCmd.INIT);
+    }
   }
 }
 
@@ -306,6 +703,28 @@ function bytes2hex(data) {
     }, "");
 }
 
+function u16ToBytes(value) {
+  return [(value >> 8) & 0xFF, value & 0xFF];
+}
+
+const CRC32_TABLE = Array.from({ length: 256 }, (_, n) => {
+  let c = n;
+  for (let k = 0; k < 8; k++)
+    c = (c & 1) ? (0xEDB88320 ^ (c >>> 1)) : (c >>> 1);
+  return c >>> 0;
+});
+
+function crc32(data, start = 0) {
+  let crc = (start ^ 0xFFFFFFFF) >>> 0;
+  for (let i = 0; i < data.length; i++)
+    crc = CRC32_TABLE[(crc ^ data[i]) & 0xFF] ^ (crc >>> 8);
+  return (crc ^ 0xFFFFFFFF) >>> 0;
+}
+
+function u32ToBytes(value) {
+  return [(value >>> 24) & 0xFF, (value >> 16) & 0xFF, (value >> 8) & 0xFF, value & 0xFF];
+}
+
 function intToHex(intIn) {
   let stringOut = ("0000" + intIn.toString(16)).substr(-4)
   return stringOut.substring(2, 4) + stringOut.substring(0, 2);
@@ -46,11 +46,23 @@
 #define SLAVE_LATENCY                    6                                              /**< Slave latency. */
 #define CONN_SUP_TIMEOUT                 MSEC_TO_UNITS(430, UNIT_10_MS)                 /**< Connection supervisory timeout (430 ms). */
 
+#define FAST_MIN_CONN_INTERVAL           MSEC_TO_UNITS(7.5, UNIT_1_25_MS)               /**< Minimum connection interval for bulk transfer (7.5 ms) */
+#define FAST_MAX_CONN_INTERVAL           MSEC_TO_UNITS(15, UNIT_1_25_MS)                /**< Maximum connection interval for bulk transfer (15 ms). */
+#define FAST_SLAVE_LATENCY               0                                              /**< Slave latency for bulk transfer. */
+#define FAST_CONN_SUP_TIMEOUT            MSEC_TO_UNITS(2000, UNIT_10_MS)                /**< Connection supervisory timeout for bulk transfer (2 seconds). */
+
+#define IDLE_MIN_CONN_INTERVAL           MSEC_TO_UNITS(200, UNIT_1_25_MS)               /**< Minimum connection interval when idle (200 ms) */
+#define IDLE_MAX_CONN_INTERVAL           MSEC_TO_UNITS(400, UNIT_1_25_MS)               /**< Maximum connection interval when idle (400 ms). */
+#define IDLE_SLAVE_LATENCY               4                                              /**< Slave latency when idle. */
+#define IDLE_CONN_SUP_TIMEOUT            MSEC_TO_UNITS(6000, UNIT_10_MS)                /**< Connection supervisory timeout when idle (6 seconds). */
+
+#define IDLE_TIMER_INTERVAL              APP_TIMER_TICKS(10000, APP_TIMER_PRESCALER)    /**< Time without commands before the idle profile is requested (10 seconds). */
+
 #define FIRST_CONN_PARAMS_UPDATE_DELAY   APP_TIMER_TICKS(5000, APP_TIMER_PRESCALER)     /**< Time from initiating event (connect or start of notification) to first time sd_ble_gap_conn_param_update is called (5 seconds). */
 #define NEXT_CONN_PARAMS_UPDATE_DELAY    APP_TIMER_TICKS(30000, APP_TIMER_PRESCALER)    /**< Time between each call to sd_ble_gap_conn_param_update after the first call (30 seconds). */
 #define MAX_CONN_PARAMS_UPDATE_COUNT     3                                              /**< Number of attempts before giving up the connection parameter negotiation. */
 
-#define SCHED_MAX_EVENT_DATA_SIZE       0                                               /**< Maximum size of scheduler events. */
+#define SCHED_MAX_EVENT_DATA_SIZE       sizeof(ble_epd_t *)                             /**< Maximum size of scheduler events. */
 #define SCHED_QUEUE_SIZE                10                                              /**< Maximum number of events in the scheduler queue. */
 
 #define CLOCK_TIMER_INTERVAL             APP_TIMER_TICKS(1000, APP_TIMER_PRESCALER)     /**< Clock timer interval (ticks). */
@@ -58,6 +70,7 @@
 #define DEAD_BEEF                        0xDEADBEEF                                     /**< Value used as error code on stack dump, can be used to identify stack location on stack unwind. */
 
 static uint16_t                          m_driver_refs = 0;
+static bool                              m_driver_held = false;                         /**< Connection ref kept for an open frame transaction. */
 static uint16_t                          m_conn_handle = BLE_CONN_HANDLE_INVALID;       /**< Handle of the current connection. */
 static ble_uuid_t                        m_adv_uuids[] = {{BLE_UUID_EPD_SERVICE, \
                                                            EPD_SERVICE_UUID_TYPE}};     /**< Universally unique service identifier. */
@@ -65,7 +78,19 @@ static ble_epd_t                         m_epd;
 static uint32_t                          m_timestamp = 1735689600;                      /**< Current timestamp. */
 static bool                              m_calendar_mode = false;                       /**< Whether we are in calendar mode */
 
+/**< Connection parameter profiles. */
+typedef enum
+{
+    CONN_PROFILE_DEFAULT,                                                               /**< PPCP negotiated on connect */
+    CONN_PROFILE_FAST,                                                                  /**< short interval, no latency for bulk transfer */
+    CONN_PROFILE_IDLE,                                                                  /**< long interval, high latency while idle */
+} conn_profile_t;
+
+static conn_profile_t                    m_conn_profile = CONN_PROFILE_DEFAULT;         /**< Requested connection parameter profile. */
+static bool                              m_link_active = false;                         /**< A command was received since the last idle check. */
+
 APP_TIMER_DEF(m_clock_timer_id);                                                        /**< Clock timer. */
+APP_TIMER_DEF(m_idle_timer_id);                                                         /**< Link idle timer. */
 
 static void epd_driver_init()
 {
@@ -85,12 +110,41 @@ static void epd_driver_exit()
     }
 }
 
+static void epd_connected(void * p_event_data, uint16_t event_size)
+{
+    if (m_driver_held)
+        m_driver_held = false;
+    else
+        epd_driver_init();
+}
+
+static void epd_disconnected(void * p_event_data, uint16_t event_size)
+{
+    ble_epd_refresh_wait(&m_epd);
+
+    // keep EPD ram for the host to resume the frame
+    if (m_epd.frame.open)
+        m_driver_held = true;
+    else
+        epd_driver_exit();
+}
+
 static void calendar_update(void * p_event_data, uint16_t event_size)
 {
+    ble_epd_refresh_wait(&m_epd);
+
     m_calendar_mode = true;
+    ble_epd_frame_reset(&m_epd);
+    m_epd.frame.open = false;
+    m_epd.partial_count = 0;
+    m_epd.lut_custom = false;
     epd_driver_init();
+    // registers written by the host stay out of the calendar
+    if (m_epd.shadow_len > 0)
+        EPD_SetAwake(false);
     m_epd.driver->init();
     DrawCalendar(m_timestamp);
+    ble_epd_display(&m_epd);
     epd_driver_exit();
 }
 
@@ -126,6 +180,52 @@ static void clock_timer_timeout_handler(void * p_context)
         calendar_update_schedule();
 }
 
+/**@brief Function for requesting a connection parameter profile from the central.
+ */
+static void conn_profile_set(conn_profile_t profile)
+{
+    ble_gap_conn_params_t params;
+
+    if (m_conn_handle == BLE_CONN_HANDLE_INVALID || m_conn_profile == profile)
+        return;
+
+    if (profile == CONN_PROFILE_DEFAULT)
+    {
+        params.min_conn_interval = MIN_CONN_INTERVAL;
+        params.max_conn_interval = MAX_CONN_INTERVAL;
+        params.slave_latency     = SLAVE_LATENCY;
+        params.conn_sup_timeout  = CONN_SUP_TIMEOUT;
+    }
+    else if (profile == CONN_PROFILE_FAST)
+    {
+        params.min_conn_interval = FAST_MIN_CONN_INTERVAL;
+        params.max_conn_interval = FAST_MAX_CONN_INTERVAL;
+        params.slave_latency     = FAST_SLAVE_LATENCY;
+        params.conn_sup_timeout  = FAST_CONN_SUP_TIMEOUT;
+    }
+    else
+    {
+        params.min_conn_interval = IDLE_MIN_CONN_INTERVAL;
+        params.max_conn_interval = IDLE_MAX_CONN_INTERVAL;
+        params.slave_latency     = IDLE_SLAVE_LATENCY;
+        params.conn_sup_timeout  = IDLE_CONN_SUP_TIMEOUT;
+    }
+
+    NRF_LOG_DEBUG("conn profile: %d\n", profile);
+    if (ble_conn_params_change_conn_params(&params) == NRF_SUCCESS)
+        m_conn_profile = profile;
+}
+
+static void idle_timer_timeout_handler(void * p_context)
+{
+    UNUSED_PARAMETER(p_context);
+
+    if (m_link_active || ble_epd_is_busy(&m_epd))
+        m_link_active = false;
+    else
+        conn_profile_set(CONN_PROFILE_IDLE);
+}
+
 /**@brief Function for the Event Scheduler initialization.
  */
 static void scheduler_init(void)
@@ -147,6 +247,11 @@ static void timers_init(void)
                                 APP_TIMER_MODE_REPEATED,
                                 clock_timer_timeout_handler);
     APP_ERROR_CHECK(err_code);
+
+    err_code = app_timer_create(&m_idle_timer_id,
+                                APP_TIMER_MODE_REPEATED,
+                                idle_timer_timeout_handler);
+    APP_ERROR_CHECK(err_code);
 }
 
 /**@brief Function for starting application timers.
@@ -160,6 +265,8 @@ static void application_timers_start(void)
 
 bool epd_cmd_callback(uint8_t cmd, uint8_t *data, uint16_t len)
 {
+    m_link_active = true;
+
     switch (cmd)
     {
         case EPD_CMD_SET_TIME:
@@ -179,6 +286,13 @@ bool epd_cmd_callback(uint8_t cmd, uint8_t *data, uint16_t len)
             app_timer_start(m_clock_timer_id, CLOCK_TIMER_INTERVAL, NULL);
             calendar_update_schedule();
             return true;
+        case EPD_CMD_FRAME_BEGIN:
+            conn_profile_set(CONN_PROFILE_FAST);
+            break;
+        case EPD_CMD_FRAME_COMMIT:
+            conn_profile_set(CONN_PROFILE_IDLE);
+            m_calendar_mode = false;
+            break;
         case EPD_CMD_CLEAR:
         case EPD_CMD_DISPLAY:
             m_calendar_mode = false;
@@ -257,7 +371,12 @@ static void on_conn_params_evt(ble_conn_params_evt_t * p_evt)
 {
     uint32_t err_code;
 
-    if (p_evt->evt_type == BLE_CONN_PARAMS_EVT_FAILED)
+    if (p_evt->evt_type == BLE_CONN_PARAMS_EVT_FAILED && m_conn_profile != CONN_PROFILE_DEFAULT)
+    {
+        // the central may refuse a profile, keep what it gave us
+        NRF_LOG_WARNING("conn profile %d refused\n", m_conn_profile);
+    }
+    else if (p_evt->evt_type == BLE_CONN_PARAMS_EVT_FAILED)
     {
         err_code = sd_ble_gap_disconnect(m_conn_handle, BLE_HCI_CONN_INTERVAL_UNACCEPTABLE);
         APP_ERROR_CHECK(err_code);
@@ -326,7 +445,6 @@ void gpiote_evt_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
 
     nrf_drv_gpiote_in_event_disable(pin);
     nrf_drv_gpiote_in_uninit(pin);
-    nrf_drv_gpiote_uninit();
 
     advertising_start();
 }
@@ -334,8 +452,14 @@ void gpiote_evt_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
 static void setup_wakeup_pin(nrf_drv_gpiote_pin_t pin) {
     NRF_LOG_DEBUG("Setting up wakeup pin\n");
 
-    ret_code_t err_code = nrf_drv_gpiote_init();
-    APP_ERROR_CHECK(err_code);
+    ret_code_t err_code;
+
+    // GPIOTE is shared with the EPD BUSY pin
+    if (!nrf_drv_gpiote_is_init())
+    {
+        err_code = nrf_drv_gpiote_init();
+        APP_ERROR_CHECK(err_code);
+    }
 
     nrf_drv_gpiote_in_config_t config = GPIOTE_CONFIG_IN_SENSE_LOTOHI(false);
 
@@ -384,13 +508,22 @@ static void on_ble_evt(ble_evt_t * p_ble_evt)
         case BLE_GAP_EVT_CONNECTED:
             NRF_LOG_INFO("CONNECTED\n");
             m_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
-            epd_driver_init();
+            // the last connection may have left another profile preferred
+            conn_profile_set(CONN_PROFILE_DEFAULT);
+            m_conn_profile = CONN_PROFILE_DEFAULT;
+            m_link_active = false;
+            err_code = app_timer_start(m_idle_timer_id, IDLE_TIMER_INTERVAL, NULL);
+            APP_ERROR_CHECK(err_code);
+            err_code = app_sched_event_put(NULL, 0, epd_connected);
+            APP_ERROR_CHECK(err_code);
             break;
 
         case BLE_GAP_EVT_DISCONNECTED:
             NRF_LOG_INFO("DISCONNECTED\n");
             m_conn_handle = BLE_CONN_HANDLE_INVALID;
-            epd_driver_exit();
+            app_timer_stop(m_idle_timer_id);
+            err_code = app_sched_event_put(NULL, 0, epd_disconnected);
+            APP_ERROR_CHECK(err_code);
             advertising_start();
             break;
 
@@ -0,0 +1,67 @@
+// Encodes a test corpus with packbits() and crc32() from html/js/main.js and
+// writes it as a C header for test_packbits.c, so the web page's encoder is
+// checked against the decoder in EPD_ble.c.
+//   node packbits.js > build/packbits_corpus.h
+const fs = require('fs');
+const path = require('path');
+const vm = require('vm');
+
+// main.js only touches the DOM from event handlers
+const page = { document: { body: {} } };
+vm.createContext(page);
+vm.runInContext(fs.readFileSync(path.join(__dirname, '../html/js/main.js'), 'utf8'), page);
+
+const ROW_BYTES = 50;                                 // a full row of the 4.2" panel
+
+let seed = 1;
+function random() {
+  seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+  return seed >> 16;
+}
+
+function run(n, value) { return Array(n).fill(value); }
+// no two neighbours are equal
+function literal(n, first = 0x10) { return Array.from({ length: n }, (_, i) => (first + i) & 0xff); }
+// fills up to whole rows with a literal
+function rows(data) { return data.concat(literal((ROW_BYTES - data.length % ROW_BYTES) % ROW_BYTES, 0x80)); }
+
+const cases = [];
+function add(name, data) { cases.push({ name, data: rows(data) }); }
+
+// runs and literals around the 128 byte limit of a PackBits packet
+for (const n of [1, 2, 3, 127, 128, 129, 130, 255, 256, 257]) {
+  add(`run ${n}`, run(n, 0x00));
+  add(`literal ${n}`, literal(n));
+}
+add('literal 128 run 128', literal(128).concat(run(128, 0xff)));
+add('run 128 literal 128', run(128, 0xff).concat(literal(128)));
+add('literal 129 run 2 literal 1', literal(129).concat(run(2, 0x55), [0xaa]));
+add('pairs', Array.from({ length: 300 }, (_, i) => (i >> 1) & 0xff));
+add('triples', Array.from({ length: 300 }, (_, i) => i % 3 ? 0x00 : 0xff));
+// a run header as the last byte of a 20 byte raw packet and of an 18 byte IMAGE_DATA chunk
+add('run header at 19', literal(18).concat(run(40, 0x33)));
+add('run header at 17', literal(16).concat(run(40, 0x33)));
+add('random', Array.from({ length: 3000 }, () => random() & 0xff));
+add('random runs', [].concat(...Array.from({ length: 200 }, () => run(1 + (random() % 40), random() & 0xff))));
+add('blank plane', run(15000, 0xff));
+add('text plane', Array.from({ length: 15000 }, (_, i) => (i % ROW_BYTES < 20 && (i / ROW_BYTES | 0) % 12 < 8) ? random() & 0xff : 0xff));
+
+function bytes(name, data) {
+  const lines = [];
+  for (let i = 0; i < data.length; i += 16)
+    lines.push('    ' + data.slice(i, i + 16).map(b => '0x' + b.toString(16).padStart(2, '0')).join(', ') + ',');
+  return `static const uint8_t ${name}[] = {\n${lines.join('\n')}\n};\n`;
+}
+
+let out = '// generated by packbits.js from html/js/main.js, do not edit\n\n';
+cases.forEach((c, i) => {
+  out += bytes(`corpus_raw_${i}`, c.data);
+  out += bytes(`corpus_packed_${i}`, page.packbits(c.data));
+});
+out += 'static const packbits_case_t m_corpus[] = {\n';
+cases.forEach((c, i) => {
+  const crc = page.crc32(c.data, 0) >>> 0;
+  out += `    { "${c.name}", corpus_raw_${i}, sizeof(corpus_raw_${i}), corpus_packed_${i}, sizeof(corpus_packed_${i}), 0x${crc.toString(16)} },\n`;
+});
+out += '};\n';
+process.stdout.write(out);
@@ -0,0 +1,417 @@
+/*****************************************************************************
+* | File        : sdk_host.c
+* | Function    : SoftDevice and SDK library stand-ins for the BLE host tests
+* | Info        :
+*   See sdk_host.h. Only what EPD_ble.c calls is implemented.
+*
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ble.h"
+#include "nrf_soc.h"
+#include "nrf_nvic.h"
+#include "fstorage.h"
+#include "app_scheduler.h"
+#include "app_timer.h"
+#include "app_error.h"
+#include "sdk_host.h"
+
+#define HOST_FLASH_WORDS                   256        /**< one 1 KiB page */
+#define HOST_SCHED_SIZE                    32
+#define HOST_SCHED_DATA                    16
+#define HOST_TIMERS                        4
+
+typedef struct
+{
+    app_sched_event_handler_t handler;
+    uint8_t  data[HOST_SCHED_DATA];
+    uint16_t size;
+} host_event_t;
+
+/**< A single shot app_timer, it only expires when the test says so */
+typedef struct
+{
+    app_timer_id_t id;
+    app_timer_timeout_handler_t handler;
+    void * p_context;
+    bool running;
+} host_timer_t;
+
+static uint32_t m_flash[HOST_FLASH_WORDS];
+static host_event_t m_sched[HOST_SCHED_SIZE];
+static uint8_t m_sched_head, m_sched_tail;
+static host_notify_t m_notify[HOST_NOTIFY_MAX];
+static uint32_t m_notify_count;
+static bool m_notify_blocked;
+static bool m_reset_requested;
+static host_timer_t m_timers[HOST_TIMERS];
+
+/**< EPD_ble.o is built with its .fs_data section renamed to fs_data so the linker delimits it */
+extern fs_config_t __start_fs_data;
+extern fs_config_t __stop_fs_data;
+
+/******************************************************************************
+function: Test control
+******************************************************************************/
+void host_power_on(void)
+{
+    memset(m_flash, 0xFF, sizeof(m_flash));
+    host_system_reset();
+}
+
+void host_system_reset(void)
+{
+    m_sched_head = m_sched_tail = 0;
+    m_notify_blocked = false;
+    m_reset_requested = false;
+    memset(m_timers, 0, sizeof(m_timers));
+    host_notify_clear();
+}
+
+bool host_system_reset_requested(void)
+{
+    return m_reset_requested;
+}
+
+void host_epd_init(ble_epd_t * p_epd)
+{
+    memset(p_epd, 0, sizeof(ble_epd_t));
+    fs_init();
+    if (ble_epd_init(p_epd, NULL) != NRF_SUCCESS)
+    {
+        fprintf(stderr, "ble_epd_init failed\n");
+        abort();
+    }
+}
+
+void host_connect(ble_epd_t * p_epd)
+{
+    ble_evt_t evt;
+
+    memset(&evt, 0, sizeof(evt));
+    evt.header.evt_id = BLE_GAP_EVT_CONNECTED;
+    evt.evt.gap_evt.conn_handle = HOST_CONN_HANDLE;
+    evt.evt.gap_evt.params.connected.conn_params.max_conn_interval = 12;
+    evt.evt.gap_evt.params.connected.conn_params.conn_sup_timeout = 400;
+    ble_epd_on_ble_evt(p_epd, &evt);
+}
+
+void host_disconnect(ble_epd_t * p_epd)
+{
+    ble_evt_t evt;
+
+    memset(&evt, 0, sizeof(evt));
+    evt.header.evt_id = BLE_GAP_EVT_DISCONNECTED;
+    evt.evt.gap_evt.conn_handle = HOST_CONN_HANDLE;
+    ble_epd_on_ble_evt(p_epd, &evt);
+}
+
+static void host_gatts_write(ble_epd_t * p_epd, uint16_t handle, const uint8_t * p_data, uint16_t length)
+{
+    union
+    {
+        ble_evt_t evt;
+        uint8_t   raw[sizeof(ble_evt_t) + BLE_EPD_MAX_DATA_LEN + 8];
+    } u;
+    ble_gatts_evt_write_t * p_write = &u.evt.evt.gatts_evt.params.write;
+
+    memset(&u, 0, sizeof(u));
+    u.evt.header.evt_id = BLE_GATTS_EVT_WRITE;
+    u.evt.evt.gatts_evt.conn_handle = HOST_CONN_HANDLE;
+    p_write->handle = handle;
+    p_write->len = length;
+    memcpy(p_write->data, p_data, length);
+    ble_epd_on_ble_evt(p_epd, &u.evt);
+}
+
+void host_notify_enable(ble_epd_t * p_epd)
+{
+    static const uint8_t cccd[] = {BLE_GATT_HVX_NOTIFICATION, 0x00};
+    host_gatts_write(p_epd, HOST_CCCD_HANDLE, cccd, sizeof(cccd));
+}
+
+void host_write(ble_epd_t * p_epd, const uint8_t * p_data, uint16_t length)
+{
+    host_gatts_write(p_epd, HOST_VALUE_HANDLE, p_data, length);
+}
+
+void host_tx_complete(ble_epd_t * p_epd)
+{
+    ble_evt_t evt;
+
+    memset(&evt, 0, sizeof(evt));
+    evt.header.evt_id = BLE_EVT_TX_COMPLETE;
+    evt.evt.common_evt.conn_handle = HOST_CONN_HANDLE;
+    evt.evt.common_evt.params.tx_complete.count = 1;
+    ble_epd_on_ble_evt(p_epd, &evt);
+}
+
+bool host_sched_step(void)
+{
+    if (m_sched_head == m_sched_tail) return false;
+
+    host_event_t event = m_sched[m_sched_tail % HOST_SCHED_SIZE];
+    m_sched_tail++;
+    event.handler(event.data, event.size);
+    return true;
+}
+
+uint32_t host_sched_run(void)
+{
+    uint32_t n = 0;
+    while (host_sched_step())
+        n++;
+    return n;
+}
+
+void host_notify_block(bool block)
+{
+    m_notify_blocked = block;
+}
+
+void host_notify_clear(void)
+{
+    m_notify_count = 0;
+}
+
+uint32_t host_notify_count(uint8_t id)
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < m_notify_count; i++)
+        if (m_notify[i].data[0] == id) n++;
+    return n;
+}
+
+const host_notify_t * host_notify_last(uint8_t id)
+{
+    for (uint32_t i = m_notify_count; i > 0; i--)
+        if (m_notify[i - 1].data[0] == id) return &m_notify[i - 1];
+    return NULL;
+}
+
+uint32_t host_credits(void)
+{
+    uint32_t credits = 0;
+    for (uint32_t i = 0; i < m_notify_count; i++)
+        if (m_notify[i].data[0] == EPD_NOTIFY_CREDITS) credits += m_notify[i].data[1];
+    return credits;
+}
+
+/******************************************************************************
+function: SoftDevice
+******************************************************************************/
+uint32_t sd_ble_uuid_vs_add(ble_uuid128_t const * p_vs_uuid, uint8_t * p_uuid_type)
+{
+    *p_uuid_type = BLE_UUID_TYPE_VENDOR_BEGIN;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_service_add(uint8_t type, ble_uuid_t const * p_uuid, uint16_t * p_handle)
+{
+    *p_handle = HOST_VALUE_HANDLE - 2;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_characteristic_add(uint16_t service_handle, ble_gatts_char_md_t const * p_char_md,
+                                         ble_gatts_attr_t const * p_attr_char_value,
+                                         ble_gatts_char_handles_t * p_handles)
+{
+    memset(p_handles, 0, sizeof(*p_handles));
+    p_handles->value_handle = HOST_VALUE_HANDLE;
+    p_handles->cccd_handle = HOST_CCCD_HANDLE;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_hvx(uint16_t conn_handle, ble_gatts_hvx_params_t const * p_hvx_params)
+{
+    uint16_t len = *p_hvx_params->p_len;
+
+    if (m_notify_blocked) return BLE_ERROR_NO_TX_PACKETS;
+    if (len == 0 || len > BLE_EPD_MAX_DATA_LEN || m_notify_count == HOST_NOTIFY_MAX)
+    {
+        fprintf(stderr, "sd_ble_gatts_hvx: bad length %u or log full\n", len);
+        abort();
+    }
+    m_notify[m_notify_count].len = len;
+    memcpy(m_notify[m_notify_count].data, p_hvx_params->p_data, len);
+    m_notify_count++;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_address_get(ble_gap_addr_t * p_addr)
+{
+    static const uint8_t addr[BLE_GAP_ADDR_LEN] = {0x66, 0x55, 0x44, 0x33, 0x22, 0xC1};
+    memset(p_addr, 0, sizeof(*p_addr));
+    memcpy(p_addr->addr, addr, sizeof(addr));
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_power_system_off(void)
+{
+    return NRF_SUCCESS;
+}
+
+/**< sd_nvic_SystemReset() ends up here */
+void NVIC_SystemReset(void)
+{
+    m_reset_requested = true;
+}
+
+/******************************************************************************
+function: SDK libraries
+******************************************************************************/
+void app_util_critical_region_enter(uint8_t *p_nested)
+{
+}
+
+void app_util_critical_region_exit(uint8_t nested)
+{
+}
+
+void app_error_handler_bare(ret_code_t error_code)
+{
+    fprintf(stderr, "APP_ERROR_CHECK: 0x%x\n", (unsigned)error_code);
+    abort();
+}
+
+uint32_t app_sched_event_put(void * p_event_data, uint16_t event_size, app_sched_event_handler_t handler)
+{
+    if ((uint8_t)(m_sched_head - m_sched_tail) >= HOST_SCHED_SIZE || event_size > HOST_SCHED_DATA)
+        return NRF_ERROR_NO_MEM;
+
+    host_event_t * p_event = &m_sched[m_sched_head % HOST_SCHED_SIZE];
+    p_event->handler = handler;
+    p_event->size = event_size;
+    memcpy(p_event->data, p_event_data, event_size);
+    m_sched_head++;
+    return NRF_SUCCESS;
+}
+
+static host_timer_t * host_timer(app_timer_id_t id)
+{
+    for (uint8_t i = 0; i < HOST_TIMERS; i++)
+        if (m_timers[i].id == id)
+            return &m_timers[i];
+    return NULL;
+}
+
+void host_timer_expire(void)
+{
+    for (uint8_t i = 0; i < HOST_TIMERS; i++)
+    {
+        if (!m_timers[i].running) continue;
+        m_timers[i].running = false;
+        m_timers[i].handler(m_timers[i].p_context);
+    }
+}
+
+uint32_t app_timer_create(app_timer_id_t const * p_timer_id, app_timer_mode_t mode,
+                          app_timer_timeout_handler_t timeout_handler)
+{
+    host_timer_t * p_timer = host_timer(*p_timer_id);
+    if (p_timer == NULL)
+        p_timer = host_timer(NULL);
+    if (p_timer == NULL || mode != APP_TIMER_MODE_SINGLE_SHOT)
+        return NRF_ERROR_NO_MEM;
+
+    p_timer->id = *p_timer_id;
+    p_timer->handler = timeout_handler;
+    p_timer->running = false;
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void * p_context)
+{
+    host_timer_t * p_timer = host_timer(timer_id);
+    if (p_timer == NULL)
+        return NRF_ERROR_INVALID_STATE;
+
+    p_timer->p_context = p_context;
+    p_timer->running = true;
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_stop(app_timer_id_t timer_id)
+{
+    host_timer_t * p_timer = host_timer(timer_id);
+    if (p_timer != NULL)
+        p_timer->running = false;
+    return NRF_SUCCESS;
+}
+
+bool ble_srv_is_notification_enabled(uint8_t const * p_encoded_data)
+{
+    return (p_encoded_data[0] & BLE_GATT_HVX_NOTIFICATION) != 0;
+}
+
+/**< Every registered config gets its own page, in registration order */
+fs_ret_t fs_init(void)
+{
+    uint32_t * page = m_flash;
+    for (fs_config_t * p_config = &__start_fs_data; p_config < &__stop_fs_data; p_config++)
+    {
+        p_config->p_start_addr = page;
+        p_config->p_end_addr = page + HOST_FLASH_WORDS;
+        page += HOST_FLASH_WORDS;
+    }
+    if (page > m_flash + HOST_FLASH_WORDS)
+    {
+        fprintf(stderr, "fs_init: more than one page registered\n");
+        abort();
+    }
+    return FS_SUCCESS;
+}
+
+static void fs_done(fs_config_t const * const p_config, fs_evt_id_t id)
+{
+    fs_evt_t evt;
+    memset(&evt, 0, sizeof(evt));
+    evt.id = id;
+    if (p_config->callback != NULL)
+        p_config->callback(&evt, FS_SUCCESS);
+}
+
+/**< Programming can only clear bits, as on the real flash */
+fs_ret_t fs_store(fs_config_t const * const p_config, uint32_t const * const p_dest,
+                  uint32_t const * const p_src, uint16_t length_words, void * p_context)
+{
+    uint32_t * p_word = (uint32_t *)p_dest;
+
+    if (p_dest < p_config->p_start_addr || p_dest + length_words > p_config->p_end_addr)
+        return FS_ERR_INVALID_ADDR;
+    for (uint16_t i = 0; i < length_words; i++)
+        p_word[i] &= p_src[i];
+    fs_done(p_config, FS_EVT_STORE);
+    return FS_SUCCESS;
+}
+
+fs_ret_t fs_erase(fs_config_t const * const p_config, uint32_t const * const p_page_addr,
+                  uint16_t num_pages, void * p_context)
+{
+    if (p_page_addr != p_config->p_start_addr || num_pages != 1)
+        return FS_ERR_INVALID_ADDR;
+    memset((uint32_t *)p_page_addr, 0xFF, HOST_FLASH_WORDS * sizeof(uint32_t));
+    fs_done(p_config, FS_EVT_ERASE);
+    return FS_SUCCESS;
+}
+
+/******************************************************************************
+function: LED and wakeup pins, the EPD pins are simulated by EPD_sim.c
+******************************************************************************/
+void nrf_gpio_pin_set(uint32_t pin)
+{
+}
+
+void nrf_gpio_pin_clear(uint32_t pin)
+{
+}
+
+void nrf_gpio_pin_toggle(uint32_t pin)
+{
+}
+
+void nrf_gpio_cfg_sense_input(uint32_t pin, uint32_t pull, uint32_t sense)
+{
+}
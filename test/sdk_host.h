@@ -0,0 +1,63 @@
+/*****************************************************************************
+* | File        : sdk_host.h
+* | Function    : SoftDevice and SDK library stand-ins for the BLE host tests
+* | Info        :
+*   EPD_ble.c is built for the host with the SDK headers and
+*   SVCALL_AS_NORMAL_FUNCTION, the SoftDevice calls and the libraries it
+*   uses are implemented in sdk_host.c: notifications are recorded, the
+*   scheduler runs when the test asks for it and flash is a RAM page.
+*
+******************************************************************************/
+
+#ifndef __SDK_HOST_H
+#define __SDK_HOST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "EPD_ble.h"
+
+#define HOST_VALUE_HANDLE                  0x0010
+#define HOST_CCCD_HANDLE                   0x0011
+#define HOST_CONN_HANDLE                   0x0001
+#define HOST_NOTIFY_MAX                    256
+
+/**< A notification sent to the peer */
+typedef struct
+{
+    uint8_t  len;
+    uint8_t  data[BLE_EPD_MAX_DATA_LEN];
+} host_notify_t;
+
+/**< Erases flash and clears everything recorded, as after a power cycle */
+void host_power_on(void);
+/**< Loses RAM but not flash, as after sd_nvic_SystemReset() */
+void host_system_reset(void);
+bool host_system_reset_requested(void);
+
+/**< ble_epd_init() on a fresh service structure after fs_init() */
+void host_epd_init(ble_epd_t * p_epd);
+void host_connect(ble_epd_t * p_epd);
+void host_disconnect(ble_epd_t * p_epd);
+void host_notify_enable(ble_epd_t * p_epd);
+/**< A write to the EPD characteristic, from the BLE event handler */
+void host_write(ble_epd_t * p_epd, const uint8_t * p_data, uint16_t length);
+void host_tx_complete(ble_epd_t * p_epd);
+
+/**< Runs one scheduler event, false if none is queued */
+bool host_sched_step(void);
+/**< Runs scheduler events until the queue is empty, returns how many ran */
+uint32_t host_sched_run(void);
+
+/**< Makes sd_ble_gatts_hvx fail with BLE_ERROR_NO_TX_PACKETS */
+void host_notify_block(bool block);
+void host_notify_clear(void);
+uint32_t host_notify_count(uint8_t id);
+/**< The last notification of @p id, NULL if none */
+const host_notify_t * host_notify_last(uint8_t id);
+/**< Sum of the credits granted since the last host_notify_clear() */
+uint32_t host_credits(void);
+
+/**< Expires the running app_timer timers, their handlers run as from the RTC1 interrupt */
+void host_timer_expire(void);
+
+#endif
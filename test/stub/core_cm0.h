@@ -0,0 +1,68 @@
+/*****************************************************************************
+* | File        : core_cm0.h
+* | Function    : Host stand-in for the CMSIS Cortex-M0 core header
+* | Info        :
+*   Found before the SDK one by the host tests, so nrf.h and the SoftDevice
+*   headers compile without ARM instructions.
+*
+******************************************************************************/
+
+#ifndef __CORE_CM0_H_GENERIC
+#define __CORE_CM0_H_GENERIC
+
+#include <stdint.h>
+
+#define __ASM            __asm
+#define __INLINE         inline
+#define __STATIC_INLINE  static inline
+
+#define __I              volatile const
+#define __O              volatile
+#define __IO             volatile
+#define __IM             volatile const
+#define __OM             volatile
+#define __IOM            volatile
+
+static inline void __NOP(void) {}
+static inline void __WFI(void) {}
+static inline void __WFE(void) {}
+static inline void __SEV(void) {}
+static inline void __ISB(void) { __sync_synchronize(); }
+static inline void __DSB(void) { __sync_synchronize(); }
+static inline void __DMB(void) { __sync_synchronize(); }
+static inline uint32_t __REV(uint32_t value) { return __builtin_bswap32(value); }
+static inline uint32_t __REV16(uint32_t value) { return ((value & 0xff00ff00) >> 8) | ((value & 0x00ff00ff) << 8); }
+static inline int32_t __REVSH(int32_t value) { return (int16_t)__builtin_bswap16((uint16_t)value); }
+
+static inline void __enable_irq(void) {}
+static inline void __disable_irq(void) {}
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+static inline void __set_PRIMASK(uint32_t primask) {}
+static inline uint32_t __get_IPSR(void) { return 0; }
+
+typedef struct
+{
+    __IOM uint32_t ISER[1U];
+          uint32_t RESERVED0[31U];
+    __IOM uint32_t ICER[1U];
+          uint32_t RSERVED1[31U];
+    __IOM uint32_t ISPR[1U];
+          uint32_t RESERVED2[31U];
+    __IOM uint32_t ICPR[1U];
+          uint32_t RESERVED3[31U];
+          uint32_t RESERVED4[64U];
+    __IOM uint32_t IP[8U];
+} NVIC_Type;
+
+extern NVIC_Type *NVIC;
+
+void NVIC_EnableIRQ(int irq);
+void NVIC_DisableIRQ(int irq);
+uint32_t NVIC_GetPendingIRQ(int irq);
+void NVIC_SetPendingIRQ(int irq);
+void NVIC_ClearPendingIRQ(int irq);
+void NVIC_SetPriority(int irq, uint32_t priority);
+uint32_t NVIC_GetPriority(int irq);
+void NVIC_SystemReset(void);
+
+#endif
@@ -0,0 +1,15 @@
+/*****************************************************************************
+* | File        : nrf_delay.h
+* | Function    : Host stand-in for the SDK delays, see EPD_sim.c
+*
+******************************************************************************/
+
+#ifndef NRF_DELAY_H__
+#define NRF_DELAY_H__
+
+#include <stdint.h>
+
+void nrf_delay_us(uint32_t us);
+void nrf_delay_ms(uint32_t ms);
+
+#endif
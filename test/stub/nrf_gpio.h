@@ -0,0 +1,27 @@
+/*****************************************************************************
+* | File        : nrf_gpio.h
+* | Function    : Host stand-in for the SDK GPIO HAL
+* | Info        :
+*   The pins of the EPD are driven by EPD_sim.c, the LED and wakeup pin
+*   by test/sdk_host.c.
+*
+******************************************************************************/
+
+#ifndef NRF_GPIO_H__
+#define NRF_GPIO_H__
+
+#include <stdint.h>
+
+#define NRF_GPIO_PIN_NOPULL                0
+#define NRF_GPIO_PIN_SENSE_HIGH            2
+
+void nrf_gpio_cfg_output(uint32_t pin);
+void nrf_gpio_cfg_input(uint32_t pin, uint32_t pull);
+void nrf_gpio_cfg_sense_input(uint32_t pin, uint32_t pull, uint32_t sense);
+void nrf_gpio_pin_write(uint32_t pin, uint32_t value);
+uint32_t nrf_gpio_pin_read(uint32_t pin);
+void nrf_gpio_pin_set(uint32_t pin);
+void nrf_gpio_pin_clear(uint32_t pin);
+void nrf_gpio_pin_toggle(uint32_t pin);
+
+#endif
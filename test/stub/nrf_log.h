@@ -0,0 +1,16 @@
+/*****************************************************************************
+* | File        : nrf_log.h
+* | Function    : Host stand-in for the SDK logger, logging is off
+*
+******************************************************************************/
+
+#ifndef NRF_LOG_H_
+#define NRF_LOG_H_
+
+#define NRF_LOG_ERROR(...)
+#define NRF_LOG_WARNING(...)
+#define NRF_LOG_INFO(...)
+#define NRF_LOG_DEBUG(...)
+#define NRF_LOG_HEXDUMP_DEBUG(...)
+
+#endif
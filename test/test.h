@@ -0,0 +1,44 @@
+/*****************************************************************************
+* | File        : test.h
+* | Function    : Minimal checks for the host tests
+* | Info        :
+*   Each test is a plain program, it prints the failed checks and exits
+*   non zero if there were any. See test/Makefile.
+*
+******************************************************************************/
+
+#ifndef __TEST_H
+#define __TEST_H
+
+#include <stdio.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            test_failures++;                                                \
+        }                                                                   \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                      \
+    do {                                                                    \
+        long _a = (long)(a), _b = (long)(b);                                \
+        if (_a != _b) {                                                     \
+            fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %ld != %ld\n", \
+                    __FILE__, __LINE__, #a, #b, _a, _b);                    \
+            test_failures++;                                                \
+        }                                                                   \
+    } while (0)
+
+#define TEST_RUN(fn)                                                        \
+    do {                                                                    \
+        int _before = test_failures;                                        \
+        fn();                                                               \
+        printf("%s %s\n", test_failures == _before ? "PASS" : "FAIL", #fn); \
+    } while (0)
+
+#define TEST_EXIT() return test_failures == 0 ? 0 : 1
+
+#endif
@@ -0,0 +1,476 @@
+/*****************************************************************************
+* | File        : test_ble.c
+* | Function    : EPD Service receive queue and flow control
+* | Info        :
+*   Drives EPD_ble.c through its BLE event handler and the scheduler, with
+*   the drivers running on the UC8176 simulator.
+*
+******************************************************************************/
+
+#include <stddef.h>
+#include <string.h>
+#include "sdk_host.h"
+#include "test.h"
+
+static ble_epd_t m_epd;
+
+/**< a packet that is processed without touching the panel */
+static const uint8_t m_set_frame[] = {EPD_CMD_SET_FRAME, 0x12, 0x34, 0x56, 0x78};
+
+static void connect(void)
+{
+    host_power_on();
+    host_epd_init(&m_epd);
+    host_connect(&m_epd);
+    host_notify_enable(&m_epd);
+}
+
+static void test_credits_initial(void)
+{
+    connect();
+    CHECK_EQ(host_notify_count(EPD_NOTIFY_CONFIG), 1);
+    CHECK_EQ(host_notify_count(EPD_NOTIFY_CREDITS), 1);
+    CHECK_EQ(host_credits(), BLE_EPD_RX_QUEUE_SIZE);
+}
+
+static void test_credits_run_out(void)
+{
+    connect();
+    host_notify_clear();
+
+    // the peer spends all its credits before the scheduler gets a turn
+    for (uint8_t i = 0; i < BLE_EPD_RX_QUEUE_SIZE; i++)
+        host_write(&m_epd, m_set_frame, sizeof(m_set_frame));
+    CHECK(ble_epd_is_busy(&m_epd));
+    CHECK_EQ(host_notify_count(EPD_NOTIFY_RX_OVERFLOW), 0);
+    CHECK_EQ(host_credits(), 0);
+
+    // every scheduler event frees a batch and grants it back right away
+    CHECK(host_sched_step());
+    CHECK_EQ(host_credits(), BLE_EPD_RX_BATCH_SIZE);
+    CHECK_EQ(host_notify_last(EPD_NOTIFY_CREDITS)->data[1], BLE_EPD_RX_BATCH_SIZE);
+
+    host_sched_run();
+    CHECK(!ble_epd_is_busy(&m_epd));
+    CHECK_EQ(host_credits(), BLE_EPD_RX_QUEUE_SIZE);
+    CHECK_EQ(m_epd.frame_id, 0x12345678);
+}
+
+static void test_overflow(void)
+{
+    connect();
+    host_notify_clear();
+
+    for (uint8_t i = 0; i < BLE_EPD_RX_QUEUE_SIZE + 2; i++)
+        host_write(&m_epd, m_set_frame, sizeof(m_set_frame));
+
+    // the packets past the queue are dropped and counted
+    CHECK_EQ(host_notify_count(EPD_NOTIFY_RX_OVERFLOW), 2);
+    const host_notify_t * p_notify = host_notify_last(EPD_NOTIFY_RX_OVERFLOW);
+    CHECK_EQ(p_notify->len, 3);
+    CHECK_EQ(uint16_big_decode(&p_notify->data[1]), 2);
+    CHECK_EQ(m_epd.status.error, EPD_ERROR_RX_OVERFLOW);
+    CHECK_EQ(m_epd.status.received, BLE_EPD_RX_QUEUE_SIZE * sizeof(m_set_frame));
+
+    // only the queued ones are processed and granted again
+    host_sched_run();
+    CHECK_EQ(host_credits(), BLE_EPD_RX_QUEUE_SIZE);
+
+    // the counter starts over with the next connection
+    host_disconnect(&m_epd);
+    host_sched_run();
+    host_connect(&m_epd);
+    host_notify_enable(&m_epd);
+    host_notify_clear();
+    for (uint8_t i = 0; i < BLE_EPD_RX_QUEUE_SIZE + 1; i++)
+        host_write(&m_epd, m_set_frame, sizeof(m_set_frame));
+    CHECK_EQ(uint16_big_decode(&host_notify_last(EPD_NOTIFY_RX_OVERFLOW)->data[1]), 1);
+    host_sched_run();
+}
+
+static void test_credits_withheld(void)
+{
+    connect();
+    host_notify_clear();
+
+    for (uint8_t i = 0; i < BLE_EPD_RX_QUEUE_SIZE; i++)
+        host_write(&m_epd, m_set_frame, sizeof(m_set_frame));
+
+    // no TX buffer: the credits are kept, not lost
+    host_notify_block(true);
+    host_sched_run();
+    CHECK(!ble_epd_is_busy(&m_epd));
+    CHECK_EQ(host_credits(), 0);
+
+    // and sent once a TX buffer is free again, in one notification
+    host_notify_block(false);
+    host_tx_complete(&m_epd);
+    CHECK_EQ(host_notify_count(EPD_NOTIFY_CREDITS), 1);
+    CHECK_EQ(host_credits(), BLE_EPD_RX_QUEUE_SIZE);
+
+    host_tx_complete(&m_epd);                         // nothing left to grant
+    CHECK_EQ(host_notify_count(EPD_NOTIFY_CREDITS), 1);
+}
+
+static void test_credits_without_notification(void)
+{
+    host_power_on();
+    host_epd_init(&m_epd);
+    host_connect(&m_epd);
+
+    // the peer never enabled notifications, the queue still drains
+    for (uint8_t i = 0; i < BLE_EPD_RX_QUEUE_SIZE; i++)
+        host_write(&m_epd, m_set_frame, sizeof(m_set_frame));
+    host_sched_run();
+    CHECK(!ble_epd_is_busy(&m_epd));
+    CHECK_EQ(host_credits(), 0);
+
+    // enabling them grants the whole free queue once, not on top of the kept credits
+    host_notify_enable(&m_epd);
+    CHECK_EQ(host_credits(), BLE_EPD_RX_QUEUE_SIZE);
+}
+
+static void test_disconnect_image_window(void)
+{
+    const uint8_t image[] = {EPD_CMD_WRITE_IMAGE, 0x13, 0, 0, 0, 100, 400 >> 8, 400 & 0xFF, 0, 2, 0, 100};
+    const uint8_t data[10] = {0};
+    const uint8_t dtm2[] = {EPD_CMD_SEND_COMMAND, 0x13};
+    const uint8_t pixels[] = {EPD_CMD_SEND_DATA, 0x12, 0x34, 0x56, 0x78};
+
+    connect();
+    DEV_Module_Init();                                // main.c does it on connection
+    host_write(&m_epd, image, sizeof(image));
+    host_write(&m_epd, data, sizeof(data));
+    host_sched_run();
+    CHECK_EQ(m_epd.image.remaining, 90);
+
+    // the link drops in the middle of the window
+    host_disconnect(&m_epd);
+    host_sched_run();
+    CHECK_EQ(m_epd.image.remaining, 0);
+
+    // data written by hand goes to the whole panel again, not to the old window
+    host_connect(&m_epd);
+    host_write(&m_epd, dtm2, sizeof(dtm2));
+    host_write(&m_epd, pixels, sizeof(pixels));
+    host_sched_run();
+    DEV_SPI_Flush();
+    CHECK(memcmp(epd_sim_ram(1), &pixels[1], sizeof(pixels) - 1) == 0);
+    CHECK_EQ(epd_sim_stats()->bus_errors, 0);
+    DEV_Module_Exit();
+}
+
+static void test_batch_image(void)
+{
+    // SET_FRAME, then WRITE_IMAGE of a raw window
+    const uint8_t batch[] = {EPD_CMD_BATCH,
+                             5, EPD_CMD_SET_FRAME, 0x00, 0x00, 0x00, 0x01,
+                             12, EPD_CMD_WRITE_IMAGE, 0x13, 0, 0, 0, 0, 0, 8, 0, 1, 0, 5};
+    const uint8_t after[] = {EPD_CMD_BATCH, 5, EPD_CMD_SET_FRAME, 0x00, 0x00, 0x00, 0x02};
+    const uint8_t data[] = {EPD_CMD_BATCH, 3, EPD_CMD_IMAGE_DATA, 0, 0xFF, 5, EPD_CMD_SET_FRAME, 0, 0, 0, 3};
+
+    connect();
+    DEV_Module_Init();
+
+    // the window is refused, the packets after it are not image data
+    host_write(&m_epd, batch, sizeof(batch));
+    host_sched_run();
+    CHECK_EQ(m_epd.image.remaining, 0);
+    CHECK_EQ(m_epd.status.error, EPD_ERROR_IMAGE_INVALID);
+    CHECK_EQ(m_epd.frame_id, 1);
+    host_write(&m_epd, after, sizeof(after));
+    host_sched_run();
+    CHECK_EQ(m_epd.frame_id, 2);
+
+    // the batch ends at IMAGE_DATA as well
+    host_write(&m_epd, data, sizeof(data));
+    host_sched_run();
+    CHECK_EQ(m_epd.frame_id, 2);
+    DEV_Module_Exit();
+}
+
+static void test_frame_dropped(void)
+{
+    const uint8_t clear[] = {EPD_CMD_CLEAR};
+    const uint8_t command[] = {EPD_CMD_SEND_COMMAND, 0x91};
+
+    connect();
+    DEV_Module_Init();
+    host_notify_clear();
+
+    // the host learns of every token change, so it never sends a delta against a lost frame
+    host_write(&m_epd, m_set_frame, sizeof(m_set_frame));
+    host_sched_run();
+    CHECK_EQ(host_notify_count(EPD_NOTIFY_FRAME), 1);
+    CHECK_EQ(uint32_big_decode(&host_notify_last(EPD_NOTIFY_FRAME)->data[1 + BLE_GAP_ADDR_LEN]), 0x12345678);
+
+    host_write(&m_epd, clear, sizeof(clear));
+    host_sched_run();
+    ble_epd_refresh_wait(&m_epd);
+    CHECK_EQ(host_notify_count(EPD_NOTIFY_FRAME), 2);
+    CHECK_EQ(uint32_big_decode(&host_notify_last(EPD_NOTIFY_FRAME)->data[1 + BLE_GAP_ADDR_LEN]), 0);
+
+    host_write(&m_epd, m_set_frame, sizeof(m_set_frame));
+    host_write(&m_epd, command, sizeof(command));
+    host_sched_run();
+    CHECK_EQ(host_notify_count(EPD_NOTIFY_FRAME), 4);
+    CHECK_EQ(m_epd.frame_id, 0);
+
+    // nothing to tell when the token does not change, the calendar drops it the same way
+    ble_epd_frame_reset(&m_epd);
+    CHECK_EQ(host_notify_count(EPD_NOTIFY_FRAME), 4);
+    host_write(&m_epd, m_set_frame, sizeof(m_set_frame));
+    host_sched_run();
+    ble_epd_frame_reset(&m_epd);
+    CHECK_EQ(host_notify_count(EPD_NOTIFY_FRAME), 6);
+    CHECK_EQ(uint32_big_decode(&host_notify_last(EPD_NOTIFY_FRAME)->data[1 + BLE_GAP_ADDR_LEN]), 0);
+    DEV_Module_Exit();
+}
+
+static void test_init_host_commands(void)
+{
+    const uint8_t init[] = {EPD_CMD_INIT};
+    const uint8_t vcom[] = {EPD_CMD_SEND_COMMAND, 0x50};
+    const uint8_t vcom_data[] = {EPD_CMD_SEND_DATA, 0x97};
+    const uint8_t partial_in[] = {EPD_CMD_SEND_COMMAND, 0x91};
+
+    connect();
+    DEV_Module_Init();
+    host_write(&m_epd, init, sizeof(init));
+    host_sched_run();
+    uint32_t resets = epd_sim_stats()->resets;
+
+    // a register is written back by INIT, the controller is not reset for it
+    host_write(&m_epd, vcom, sizeof(vcom));
+    host_write(&m_epd, vcom_data, sizeof(vcom_data));
+    host_write(&m_epd, init, sizeof(init));
+    host_sched_run();
+    CHECK_EQ(epd_sim_stats()->resets, resets);
+    CHECK(EPD_IsAwake());
+
+    // partial mode is not, only a reset leaves it
+    host_write(&m_epd, partial_in, sizeof(partial_in));
+    host_sched_run();
+    CHECK(!EPD_IsAwake());
+    host_write(&m_epd, init, sizeof(init));
+    host_sched_run();
+    CHECK(epd_sim_stats()->resets > resets);
+    CHECK(EPD_IsAwake());
+    CHECK_EQ(epd_sim_stats()->bus_errors, 0);
+    DEV_Module_Exit();
+}
+
+/**< Writes a new byte to EPD ram, so the frame is not skipped as unchanged, and shows it */
+static uint8_t display(uint8_t pixels)
+{
+    const uint8_t dtm2[] = {EPD_CMD_SEND_COMMAND, 0x13};
+    const uint8_t data[] = {EPD_CMD_SEND_DATA, pixels};
+    const uint8_t show[] = {EPD_CMD_DISPLAY};
+
+    host_write(&m_epd, dtm2, sizeof(dtm2));
+    host_write(&m_epd, data, sizeof(data));
+    host_write(&m_epd, show, sizeof(show));
+    host_sched_run();
+    ble_epd_refresh_wait(&m_epd);
+    return m_epd.status.waveform;
+}
+
+static void set_waveform(uint8_t waveform)
+{
+    uint8_t config[1 + offsetof(epd_config_t, waveform) + 1] = {EPD_CMD_SET_CONFIG};
+
+    memcpy(&config[1], &m_epd.config, sizeof(config) - 1);
+    config[sizeof(config) - 1] = waveform;
+    host_write(&m_epd, config, sizeof(config));
+    host_sched_run();
+}
+
+static void test_waveform_opt_in(void)
+{
+    const uint8_t init[] = {EPD_CMD_INIT};
+
+    connect();
+    DEV_Module_Init();
+    host_write(&m_epd, init, sizeof(init));
+    host_sched_run();
+
+    // the config of a device out of the box leaves the waveform unset
+    CHECK_EQ(m_epd.config.waveform, 0xFF);
+    epd_sim_set_temperature(23);
+    CHECK_EQ(display(1), EPD_WAVEFORM_OTP);
+    CHECK_EQ(m_epd.status.temperature, EPD_TEMPERATURE_UNKNOWN);
+
+    // register LUTs only when asked for, the temperature is only read to pick one
+    set_waveform(EPD_WAVEFORM_AUTO);
+    CHECK_EQ(display(2), 1);
+    CHECK_EQ(m_epd.status.temperature, 23);
+    epd_sim_set_temperature(-7);
+    CHECK_EQ(display(3), EPD_WAVEFORM_OTP);
+    CHECK_EQ(m_epd.status.temperature, -7);
+    set_waveform(1);
+    CHECK_EQ(display(4), 1);
+    CHECK_EQ(m_epd.status.temperature, EPD_TEMPERATURE_UNKNOWN);
+    set_waveform(EPD_WAVEFORM_OTP);
+    CHECK_EQ(display(5), EPD_WAVEFORM_OTP);
+    CHECK_EQ(m_epd.status.temperature, EPD_TEMPERATURE_UNKNOWN);
+    DEV_Module_Exit();
+}
+
+#define PLANE_SIZE     (400 / 8 * 300)
+
+static uint8_t m_frame[PLANE_SIZE];
+
+static void write_rows(const uint8_t * p_rows, uint16_t y, uint16_t h, uint16_t len)
+{
+    const uint8_t image[] = {EPD_CMD_WRITE_IMAGE, 0x13, 0, 0, y >> 8, y & 0xFF, 400 >> 8, 400 & 0xFF,
+                             h >> 8, h & 0xFF, len >> 8, len & 0xFF};
+
+    host_write(&m_epd, image, sizeof(image));
+    host_sched_run();
+    for (uint16_t i = 0; i < len; i += BLE_EPD_MAX_DATA_LEN)
+    {
+        host_notify_clear();
+        host_write(&m_epd, &p_rows[i], len - i < BLE_EPD_MAX_DATA_LEN ? len - i : BLE_EPD_MAX_DATA_LEN);
+        host_sched_run();
+    }
+}
+
+/**< Shows what was written since the last refresh, true if the refresh was skipped */
+static bool show(void)
+{
+    const uint8_t display[] = {EPD_CMD_DISPLAY};
+    uint32_t refreshes = epd_sim_stats()->refreshes;
+
+    host_notify_clear();
+    host_write(&m_epd, display, sizeof(display));
+    host_sched_run();
+    ble_epd_refresh_wait(&m_epd);
+    CHECK_EQ(epd_sim_stats()->refreshes + host_notify_count(EPD_NOTIFY_UNCHANGED), refreshes + 1);
+    return host_notify_count(EPD_NOTIFY_UNCHANGED) > 0;
+}
+
+static void boot(void)
+{
+    const uint8_t init[] = {EPD_CMD_INIT};
+
+    host_epd_init(&m_epd);
+    host_connect(&m_epd);
+    host_notify_enable(&m_epd);
+    DEV_Module_Init();
+    host_write(&m_epd, init, sizeof(init));
+    host_sched_run();
+}
+
+/**< The MCU resets, the panel keeps its image and the controller loses its ram */
+static void mcu_reset(void)
+{
+    DEV_Module_Exit();
+    host_system_reset();
+    boot();
+}
+
+static void test_fingerprint(void)
+{
+    for (uint16_t i = 0; i < sizeof(m_frame); i++)
+        m_frame[i] = i * 13;
+
+    host_power_on();
+    boot();
+
+    // a frame written from top to bottom is recognised when it comes again the same way
+    write_rows(m_frame, 0, 300, PLANE_SIZE);
+    CHECK(!show());                                   // after INIT
+    write_rows(m_frame, 0, 300, PLANE_SIZE);
+    CHECK(!show());
+    write_rows(m_frame, 0, 300, PLANE_SIZE);
+    CHECK(show());
+
+    // and after an MCU reset, the image is still on the panel
+    mcu_reset();
+    write_rows(m_frame, 0, 300, PLANE_SIZE);
+    CHECK(!show());
+    mcu_reset();
+    write_rows(m_frame, 0, 300, PLANE_SIZE);
+    CHECK(show());
+
+    // a delta on top of it is not a frame, not even when it comes again
+    write_rows(m_frame, 0, 24, 24 * 50);
+    CHECK(!show());
+    write_rows(m_frame, 0, 24, 24 * 50);
+    CHECK(!show());
+    mcu_reset();
+    write_rows(m_frame, 0, 24, 24 * 50);
+    CHECK(!show());
+
+    // rows out of order or short of data do not cover the plane
+    write_rows(m_frame, 0, 300, PLANE_SIZE);
+    CHECK(!show());
+    write_rows(&m_frame[PLANE_SIZE / 2], 150, 150, PLANE_SIZE / 2);
+    write_rows(m_frame, 0, 150, PLANE_SIZE / 2);
+    CHECK(!show());
+    write_rows(m_frame, 0, 300, PLANE_SIZE);
+    CHECK(!show());
+    write_rows(m_frame, 0, 300, PLANE_SIZE - 50);
+    CHECK(!show());
+
+    // data sent by hand goes wherever the controller is
+    write_rows(m_frame, 0, 300, PLANE_SIZE);
+    CHECK(!show());
+    write_rows(m_frame, 0, 300, PLANE_SIZE);
+    const uint8_t data[] = {EPD_CMD_SEND_DATA, 0x00};
+    host_write(&m_epd, data, sizeof(data));
+    CHECK(!show());
+    CHECK_EQ(epd_sim_stats()->bus_errors, 0);
+    DEV_Module_Exit();
+}
+
+static void test_refresh_timeout(void)
+{
+    const uint8_t show[] = {EPD_CMD_DISPLAY};
+
+    connect();
+    DEV_Module_Init();
+    epd_sim_hold_busy(true);
+
+    // the queue waits for the refresh, the refresh timer gives up on it
+    host_write(&m_epd, show, sizeof(show));
+    host_write(&m_epd, m_set_frame, sizeof(m_set_frame));
+    host_sched_run();
+    CHECK_EQ(m_epd.status.state, EPD_STATE_REFRESHING);
+    CHECK_EQ(m_epd.frame_id, 0);
+    host_notify_clear();
+    host_timer_expire();
+    host_sched_run();
+    CHECK_EQ(m_epd.status.state, EPD_STATE_IDLE);
+    CHECK_EQ(m_epd.status.error, EPD_ERROR_REFRESH_TIMEOUT);
+    CHECK_EQ(host_notify_last(EPD_NOTIFY_STATUS)->data[2], EPD_ERROR_REFRESH_TIMEOUT);
+    CHECK_EQ(m_epd.frame_id, 0x12345678);
+
+    // and so does the calendar waiting for it
+    host_write(&m_epd, show, sizeof(show));
+    host_sched_run();
+    m_epd.status.error = EPD_ERROR_NONE;
+    ble_epd_refresh_wait(&m_epd);
+    CHECK_EQ(m_epd.status.state, EPD_STATE_IDLE);
+    CHECK_EQ(m_epd.status.error, EPD_ERROR_REFRESH_TIMEOUT);
+
+    epd_sim_hold_busy(false);
+    DEV_Module_Exit();
+}
+
+int main(void)
+{
+    TEST_RUN(test_credits_initial);
+    TEST_RUN(test_credits_run_out);
+    TEST_RUN(test_overflow);
+    TEST_RUN(test_credits_withheld);
+    TEST_RUN(test_credits_without_notification);
+    TEST_RUN(test_disconnect_image_window);
+    TEST_RUN(test_batch_image);
+    TEST_RUN(test_frame_dropped);
+    TEST_RUN(test_init_host_commands);
+    TEST_RUN(test_waveform_opt_in);
+    TEST_RUN(test_fingerprint);
+    TEST_RUN(test_refresh_timeout);
+    TEST_EXIT();
+}
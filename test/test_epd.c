@@ -0,0 +1,204 @@
+/*****************************************************************************
+* | File        : test_epd.c
+* | Function    : UC8176 drivers against the simulator
+* | Info        :
+*   Runs the real EPD_driver.c SPI/CS/DC code on top of EPD_sim.c: init,
+*   image writes (full frame and partial window), refresh with a snapshot
+*   compared to what was written, temperature read and deep sleep.
+*
+******************************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include "EPD_driver.h"
+#include "test.h"
+
+#define WIDTH   400
+#define HEIGHT  300
+#define STRIDE  (WIDTH / 8)
+#define SNAPSHOT_PREFIX "test_epd_"
+
+static UBYTE m_frame[STRIDE * HEIGHT];
+
+static epd_driver_t *driver_start(uint8_t id)
+{
+    CHECK(epd_driver_set(id));
+    epd_driver_t *driver = epd_driver_get();
+    epd_sim_stats_reset();
+    DEV_Module_Init();
+    driver->init();
+    return driver;
+}
+
+static void driver_stop(epd_driver_t *driver)
+{
+    driver->sleep();
+    DEV_Module_Exit();
+    CHECK_EQ(epd_sim_stats()->bus_errors, 0);
+}
+
+/**< reads back <prefix>NNNN.pbm, returns the ram layout (1 is white) */
+static bool snapshot_read(uint32_t number, UBYTE *ram)
+{
+    char name[64];
+    int w = 0, h = 0;
+    bool ok;
+
+    snprintf(name, sizeof(name), SNAPSHOT_PREFIX "%04u.pbm", (unsigned)number);
+    FILE *fp = fopen(name, "rb");
+    if (fp == NULL) return false;
+    ok = fscanf(fp, "P4 %d %d", &w, &h) == 2 && fgetc(fp) == '\n'
+        && w == WIDTH && h == HEIGHT && fread(ram, 1, STRIDE * HEIGHT, fp) == STRIDE * HEIGHT;
+    fclose(fp);
+    remove(name);
+    for (UDOUBLE i = 0; i < STRIDE * HEIGHT; i++)
+        ram[i] = ~ram[i];
+    return ok;
+}
+
+static void test_init(void)
+{
+    epd_driver_t *driver = driver_start(EPD_DRIVER_4IN2);
+    const epd_sim_stats_t *stats = epd_sim_stats();
+
+    UDOUBLE resets = stats->resets;
+
+    CHECK(resets > 0);
+    CHECK(stats->commands > 0);
+    CHECK(EPD_IsAwake());
+
+    driver->init();                                   // awake, no second reset
+    CHECK_EQ(stats->resets, resets);
+    driver_stop(driver);
+    CHECK(!EPD_IsAwake());
+}
+
+static void test_write_refresh(void)
+{
+    UBYTE snapshot[STRIDE * HEIGHT];
+
+    for (UDOUBLE i = 0; i < sizeof(m_frame); i++)
+        m_frame[i] = (UBYTE)(i * 7 + i / STRIDE);
+
+    epd_driver_t *driver = driver_start(EPD_DRIVER_4IN2);
+    const epd_sim_stats_t *stats = epd_sim_stats();
+
+    epd_sim_snapshot(SNAPSHOT_PREFIX);
+    driver->write_image(m_frame, NULL, 0, 0, WIDTH, HEIGHT);
+    CHECK(memcmp(epd_sim_ram(1), m_frame, sizeof(m_frame)) == 0);
+    CHECK(stats->transfers > sizeof(m_frame) / 64); // double buffered 64 byte chunks
+
+    driver->refresh();
+    CHECK_EQ(stats->refreshes, 1);
+    CHECK(snapshot_read(1, snapshot));
+    CHECK(memcmp(snapshot, m_frame, sizeof(m_frame)) == 0);
+    epd_sim_snapshot(NULL);
+
+    driver_stop(driver);
+}
+
+static void test_partial_window(void)
+{
+    UBYTE image[6 * 20];                              // 48x20 at 80,100
+    UBYTE expect[STRIDE * HEIGHT];
+
+    for (UBYTE i = 0; i < sizeof(image); i++)
+        image[i] = i;
+
+    epd_driver_t *driver = driver_start(EPD_DRIVER_4IN2);
+    driver->fill_plane(0x13, 0xFF, sizeof(expect));
+    memset(expect, 0xFF, sizeof(expect));
+    for (UWORD row = 0; row < 20; row++)
+        memcpy(&expect[(100 + row) * STRIDE + 10], &image[row * 6], 6);
+
+    // streamed the way the BLE layer does it, in pieces smaller than a row
+    CHECK(driver->write_image_begin(0x13, 80, 100, 48, 20));
+    for (UBYTE i = 0; i < sizeof(image); i += 5)
+        driver->send_data(&image[i], sizeof(image) - i < 5 ? sizeof(image) - i : 5);
+    driver->write_image_end();
+    CHECK(memcmp(epd_sim_ram(1), expect, sizeof(expect)) == 0);
+
+    CHECK(!driver->write_image_begin(0x13, 380, 0, 48, 20)); // off the panel
+    driver_stop(driver);
+}
+
+static void test_color(void)
+{
+    UBYTE black[STRIDE * 4], color[STRIDE * 4];
+
+    memset(black, 0x0F, sizeof(black));
+    memset(color, 0xF0, sizeof(color));
+
+    epd_driver_t *driver = driver_start(EPD_DRIVER_4IN2B_V2);
+    driver->write_image(black, color, 0, 8, WIDTH, 4);
+    CHECK(memcmp(epd_sim_ram(0) + 8 * STRIDE, black, sizeof(black)) == 0);
+    CHECK(memcmp(epd_sim_ram(1) + 8 * STRIDE, color, sizeof(color)) == 0);
+    driver_stop(driver);
+}
+
+static void test_temperature(void)
+{
+    int8_t temperature = 0;
+
+    epd_driver_t *driver = driver_start(EPD_DRIVER_4IN2);
+    epd_sim_set_temperature(-7);
+    CHECK(driver->read_temperature(&temperature));
+    CHECK_EQ(temperature, -7);
+    epd_sim_set_temperature(23);
+    CHECK(driver->read_temperature(&temperature));
+    CHECK_EQ(temperature, 23);
+
+    // the SPI is back once the bits were clocked in by hand
+    driver->fill_plane(0x13, 0x5A, STRIDE);
+    DEV_SPI_Flush();                                  // the burst stays open until the next command
+    CHECK_EQ(epd_sim_ram(1)[STRIDE - 1], 0x5A);
+    driver_stop(driver);
+}
+
+static void test_sleep(void)
+{
+    epd_driver_t *driver = driver_start(EPD_DRIVER_4IN2);
+    UDOUBLE resets = epd_sim_stats()->resets;
+
+    driver->fill_plane(0x13, 0x00, STRIDE);
+    driver->sleep();
+    driver->fill_plane(0x13, 0xFF, STRIDE);           // ignored until the next reset
+    DEV_SPI_Flush();
+    CHECK_EQ(epd_sim_ram(1)[0], 0x00);
+    CHECK(!EPD_IsAwake());
+
+    driver->init();                                   // only a reset wakes it up
+    CHECK_EQ(epd_sim_stats()->resets, resets * 2);
+    driver->fill_plane(0x13, 0xFF, STRIDE);
+    DEV_SPI_Flush();
+    CHECK_EQ(epd_sim_ram(1)[0], 0xFF);
+    driver_stop(driver);
+}
+
+static void test_busy_timeout(void)
+{
+    epd_driver_t *driver = driver_start(EPD_DRIVER_4IN2);
+    UDOUBLE start = app_timer_cnt_get(), ticks;
+
+    // a stuck controller does not keep the CPU asleep forever
+    epd_sim_hold_busy(true);
+    CHECK(!DEV_Wait_Busy_Sleep());
+    app_timer_cnt_diff_compute(app_timer_cnt_get(), start, &ticks);
+    CHECK(ticks >= EPD_BUSY_TIMEOUT && ticks < 2 * EPD_BUSY_TIMEOUT);
+
+    epd_sim_hold_busy(false);
+    CHECK(DEV_Wait_Busy_Sleep());
+    driver_stop(driver);
+}
+
+int main(void)
+{
+    TEST_RUN(test_init);
+    TEST_RUN(test_write_refresh);
+    TEST_RUN(test_partial_window);
+    TEST_RUN(test_color);
+    TEST_RUN(test_temperature);
+    TEST_RUN(test_sleep);
+    TEST_RUN(test_busy_timeout);
+    TEST_EXIT();
+}
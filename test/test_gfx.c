@@ -0,0 +1,683 @@
+/*****************************************************************************
+* | File        : test_gfx.c
+* | Function    : GFX primitives against the pixel by pixel originals
+* | Info        :
+*   The ref_ functions are the drawing code Adafruit_GFX.c had before the
+*   span fills, page clipping and pixel writers: everything goes through
+*   ref_pixel() into a full frame. The library renders the same primitives
+*   page by page and both frames have to be equal.
+*
+******************************************************************************/
+
+#include <string.h>
+#include "Adafruit_GFX.h"
+#include "fonts.h"
+#include "test.h"
+
+#define WIDTH       76                                // not a whole number of bytes
+#define HEIGHT      52
+#define STRIDE      ((WIDTH + 7) / 8)
+#define FRAME_SIZE  (STRIDE * HEIGHT)
+#define PAGE_ROWS   8                                 // 7 pages, the last one is 4 rows
+
+#define SWAP(a, b) do { int16_t t = a; a = b; b = t; } while (0)
+
+typedef enum
+{
+    OP_PIXEL,
+    OP_LINE,
+    OP_HLINE,
+    OP_VLINE,
+    OP_FILL_RECT,
+    OP_RECT,
+    OP_ROUND_RECT,
+    OP_FILL_ROUND_RECT,
+    OP_CIRCLE,
+    OP_FILL_CIRCLE,
+    OP_TRIANGLE,
+    OP_FILL_TRIANGLE,
+    OP_BITMAP,
+    OP_TEXT,                                          // no reference, u8g2 draws it with lines
+} op_t;
+
+typedef struct
+{
+    op_t     op;
+    int16_t  a[6];
+    uint16_t color;
+} prim_t;
+
+static const uint8_t m_bitmap[] = {                   // 20x10, 3 bytes per row
+    0xF0, 0x0F, 0x30, 0x81, 0x81, 0x10, 0x42, 0x42, 0x20, 0x24, 0x24, 0x40, 0x18, 0x18, 0x80,
+    0x18, 0x18, 0x80, 0x24, 0x24, 0x40, 0x42, 0x42, 0x20, 0x81, 0x81, 0x10, 0xFF, 0x00, 0xF0,
+};
+#define BITMAP_WIDTH    20
+#define BITMAP_HEIGHT   10
+
+static uint8_t    m_page[FRAME_SIZE * 2];
+static uint8_t    m_out[2][FRAME_SIZE];                // black and red planes, 1 is white
+static uint8_t    m_ref[2][FRAME_SIZE];
+static bool       m_ref_3c;
+static GFX_Rotate m_ref_rotation;
+
+/******************************************************************************
+function: Reference
+******************************************************************************/
+static void ref_begin(bool color, GFX_Rotate r)
+{
+    m_ref_3c = color;
+    m_ref_rotation = r;
+    memset(m_ref, 0xFF, sizeof(m_ref));
+}
+
+static void ref_pixel(int16_t x, int16_t y, uint16_t color)
+{
+    bool rotated = m_ref_rotation == GFX_ROTATE_90 || m_ref_rotation == GFX_ROTATE_270;
+    if (x < 0 || x >= (rotated ? HEIGHT : WIDTH) || y < 0 || y >= (rotated ? WIDTH : HEIGHT)) return;
+
+    switch (m_ref_rotation) {
+        case GFX_ROTATE_0:
+            break;
+        case GFX_ROTATE_90:
+            SWAP(x, y);
+            x = WIDTH - x - 1;
+            break;
+        case GFX_ROTATE_180:
+            x = WIDTH - x - 1;
+            y = HEIGHT - y - 1;
+            break;
+        case GFX_ROTATE_270:
+            SWAP(x, y);
+            y = HEIGHT - y - 1;
+            break;
+    }
+
+    uint16_t i = x / 8 + y * STRIDE;
+    uint8_t mask = 0x80 >> (x & 7);
+    if (m_ref_3c) {
+        m_ref[0][i] |= mask;
+        m_ref[1][i] |= mask;
+        if (color == GFX_BLACK)
+            m_ref[0][i] &= ~mask;
+        else if (color == GFX_RED)
+            m_ref[1][i] &= ~mask;
+    } else {
+        if (color == GFX_WHITE)
+            m_ref[0][i] |= mask;
+        else
+            m_ref[0][i] &= ~mask;
+    }
+}
+
+static void ref_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color)
+{
+    int16_t steep = abs(y1 - y0) > abs(x1 - x0);
+    if (steep) {
+        SWAP(x0, y0);
+        SWAP(x1, y1);
+    }
+    if (x0 > x1) {
+        SWAP(x0, x1);
+        SWAP(y0, y1);
+    }
+
+    int16_t dx = x1 - x0;
+    int16_t dy = abs(y1 - y0);
+    int16_t err = dx / 2;
+    int16_t ystep = y0 < y1 ? 1 : -1;
+
+    for (; x0 <= x1; x0++) {
+        if (steep)
+            ref_pixel(y0, x0, color);
+        else
+            ref_pixel(x0, y0, color);
+        err -= dy;
+        if (err < 0) {
+            y0 += ystep;
+            err += dx;
+        }
+    }
+}
+
+static void ref_vline(int16_t x, int16_t y, int16_t h, uint16_t color)
+{
+    ref_line(x, y, x, y + h - 1, color);
+}
+
+static void ref_hline(int16_t x, int16_t y, int16_t w, uint16_t color)
+{
+    ref_line(x, y, x + w - 1, y, color);
+}
+
+static void ref_fill_rect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+{
+    for (int16_t i = x; i < x + w; i++)
+        ref_vline(i, y, h, color);
+}
+
+static void ref_circle_helper(int16_t x0, int16_t y0, int16_t r, uint8_t corners, uint16_t color)
+{
+    int16_t f = 1 - r, ddF_x = 1, ddF_y = -2 * r, x = 0, y = r;
+
+    while (x < y) {
+        if (f >= 0) {
+            y--;
+            ddF_y += 2;
+            f += ddF_y;
+        }
+        x++;
+        ddF_x += 2;
+        f += ddF_x;
+        if (corners & 0x4) {
+            ref_pixel(x0 + x, y0 + y, color);
+            ref_pixel(x0 + y, y0 + x, color);
+        }
+        if (corners & 0x2) {
+            ref_pixel(x0 + x, y0 - y, color);
+            ref_pixel(x0 + y, y0 - x, color);
+        }
+        if (corners & 0x8) {
+            ref_pixel(x0 - y, y0 + x, color);
+            ref_pixel(x0 - x, y0 + y, color);
+        }
+        if (corners & 0x1) {
+            ref_pixel(x0 - y, y0 - x, color);
+            ref_pixel(x0 - x, y0 - y, color);
+        }
+    }
+}
+
+static void ref_fill_circle_helper(int16_t x0, int16_t y0, int16_t r, uint8_t corners, int16_t delta,
+                                   uint16_t color)
+{
+    int16_t f = 1 - r, ddF_x = 1, ddF_y = -2 * r, x = 0, y = r, px = x, py = y;
+
+    delta++;
+    while (x < y) {
+        if (f >= 0) {
+            y--;
+            ddF_y += 2;
+            f += ddF_y;
+        }
+        x++;
+        ddF_x += 2;
+        f += ddF_x;
+        if (x < (y + 1)) {
+            if (corners & 1) ref_vline(x0 + x, y0 - y, 2 * y + delta, color);
+            if (corners & 2) ref_vline(x0 - x, y0 - y, 2 * y + delta, color);
+        }
+        if (y != py) {
+            if (corners & 1) ref_vline(x0 + py, y0 - px, 2 * px + delta, color);
+            if (corners & 2) ref_vline(x0 - py, y0 - px, 2 * px + delta, color);
+            py = y;
+        }
+        px = x;
+    }
+}
+
+static void ref_circle(int16_t x0, int16_t y0, int16_t r, uint16_t color)
+{
+    ref_pixel(x0, y0 + r, color);
+    ref_pixel(x0, y0 - r, color);
+    ref_pixel(x0 + r, y0, color);
+    ref_pixel(x0 - r, y0, color);
+    ref_circle_helper(x0, y0, r, 0xF, color);
+}
+
+static void ref_fill_triangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2,
+                              uint16_t color)
+{
+    int16_t a, b, y, last;
+
+    if (y0 > y1) {
+        SWAP(y0, y1);
+        SWAP(x0, x1);
+    }
+    if (y1 > y2) {
+        SWAP(y2, y1);
+        SWAP(x2, x1);
+    }
+    if (y0 > y1) {
+        SWAP(y0, y1);
+        SWAP(x0, x1);
+    }
+
+    if (y0 == y2) {
+        a = b = x0;
+        if (x1 < a) a = x1;
+        else if (x1 > b) b = x1;
+        if (x2 < a) a = x2;
+        else if (x2 > b) b = x2;
+        ref_hline(a, y0, b - a + 1, color);
+        return;
+    }
+
+    int16_t dx01 = x1 - x0, dy01 = y1 - y0, dx02 = x2 - x0, dy02 = y2 - y0, dx12 = x2 - x1, dy12 = y2 - y1;
+    int32_t sa = 0, sb = 0;
+
+    last = y1 == y2 ? y1 : y1 - 1;
+    for (y = y0; y <= last; y++) {
+        a = x0 + sa / dy01;
+        b = x0 + sb / dy02;
+        sa += dx01;
+        sb += dx02;
+        if (a > b) SWAP(a, b);
+        ref_hline(a, y, b - a + 1, color);
+    }
+    sa = (int32_t)dx12 * (y - y1);
+    sb = (int32_t)dx02 * (y - y0);
+    for (; y <= y2; y++) {
+        a = x1 + sa / dy12;
+        b = x0 + sb / dy02;
+        sa += dx12;
+        sb += dx02;
+        if (a > b) SWAP(a, b);
+        ref_hline(a, y, b - a + 1, color);
+    }
+}
+
+static void ref_bitmap(int16_t x, int16_t y, const uint8_t bitmap[], int16_t w, int16_t h, uint16_t color,
+                       bool invert)
+{
+    int16_t byteWidth = (w + 7) / 8;
+    uint8_t byte = 0;
+
+    for (int16_t j = 0; j < h; j++) {
+        for (int16_t i = 0; i < w; i++) {
+            if (i & 7)
+                byte <<= 1;
+            else
+                byte = bitmap[j * byteWidth + i / 8];
+            if (((byte & 0x80) == 0x80) ^ invert)
+                ref_pixel(x + i, y + j, color);
+        }
+    }
+}
+
+static void ref_draw(const prim_t *p)
+{
+    int16_t x = p->a[0], y = p->a[1], w = p->a[2], h = p->a[3], r = p->a[4];
+
+    switch (p->op) {
+        case OP_PIXEL:
+            ref_pixel(x, y, p->color);
+            break;
+        case OP_LINE:
+            ref_line(x, y, w, h, p->color);
+            break;
+        case OP_HLINE:
+            ref_hline(x, y, w, p->color);
+            break;
+        case OP_VLINE:
+            ref_vline(x, y, h, p->color);
+            break;
+        case OP_FILL_RECT:
+            ref_fill_rect(x, y, w, h, p->color);
+            break;
+        case OP_RECT:
+            ref_hline(x, y, w, p->color);
+            ref_hline(x, y + h - 1, w, p->color);
+            ref_vline(x, y, h, p->color);
+            ref_vline(x + w - 1, y, h, p->color);
+            break;
+        case OP_ROUND_RECT:
+            if (r > (w < h ? w : h) / 2) r = (w < h ? w : h) / 2;
+            ref_hline(x + r, y, w - 2 * r, p->color);
+            ref_hline(x + r, y + h - 1, w - 2 * r, p->color);
+            ref_vline(x, y + r, h - 2 * r, p->color);
+            ref_vline(x + w - 1, y + r, h - 2 * r, p->color);
+            ref_circle_helper(x + r, y + r, r, 1, p->color);
+            ref_circle_helper(x + w - r - 1, y + r, r, 2, p->color);
+            ref_circle_helper(x + w - r - 1, y + h - r - 1, r, 4, p->color);
+            ref_circle_helper(x + r, y + h - r - 1, r, 8, p->color);
+            break;
+        case OP_FILL_ROUND_RECT:
+            if (r > (w < h ? w : h) / 2) r = (w < h ? w : h) / 2;
+            ref_fill_rect(x + r, y, w - 2 * r, h, p->color);
+            ref_fill_circle_helper(x + w - r - 1, y + r, r, 1, h - 2 * r - 1, p->color);
+            ref_fill_circle_helper(x + r, y + r, r, 2, h - 2 * r - 1, p->color);
+            break;
+        case OP_CIRCLE:
+            ref_circle(x, y, r, p->color);
+            break;
+        case OP_FILL_CIRCLE:
+            ref_vline(x, y - r, 2 * r + 1, p->color);
+            ref_fill_circle_helper(x, y, r, 3, 0, p->color);
+            break;
+        case OP_TRIANGLE:
+            ref_line(x, y, w, h, p->color);
+            ref_line(w, h, r, p->a[5], p->color);
+            ref_line(r, p->a[5], x, y, p->color);
+            break;
+        case OP_FILL_TRIANGLE:
+            ref_fill_triangle(x, y, w, h, r, p->a[5], p->color);
+            break;
+        case OP_BITMAP:
+            ref_bitmap(x, y, m_bitmap, w, h, p->color, r);
+            break;
+        case OP_TEXT:                                 // only compared with bins on and off
+            break;
+    }
+}
+
+/******************************************************************************
+function: Library
+******************************************************************************/
+static void gfx_draw(Adafruit_GFX *gfx, const prim_t *p)
+{
+    int16_t x = p->a[0], y = p->a[1], w = p->a[2], h = p->a[3], r = p->a[4];
+
+    switch (p->op) {
+        case OP_PIXEL:
+            GFX_drawPixel(gfx, x, y, p->color);
+            break;
+        case OP_LINE:
+            GFX_drawLine(gfx, x, y, w, h, p->color);
+            break;
+        case OP_HLINE:
+            GFX_drawFastHLine(gfx, x, y, w, p->color);
+            break;
+        case OP_VLINE:
+            GFX_drawFastVLine(gfx, x, y, h, p->color);
+            break;
+        case OP_FILL_RECT:
+            GFX_fillRect(gfx, x, y, w, h, p->color);
+            break;
+        case OP_RECT:
+            GFX_drawRect(gfx, x, y, w, h, p->color);
+            break;
+        case OP_ROUND_RECT:
+            GFX_drawRoundRect(gfx, x, y, w, h, r, p->color);
+            break;
+        case OP_FILL_ROUND_RECT:
+            GFX_fillRoundRect(gfx, x, y, w, h, r, p->color);
+            break;
+        case OP_CIRCLE:
+            GFX_drawCircle(gfx, x, y, r, p->color);
+            break;
+        case OP_FILL_CIRCLE:
+            GFX_fillCircle(gfx, x, y, r, p->color);
+            break;
+        case OP_TRIANGLE:
+            GFX_drawTriangle(gfx, x, y, w, h, r, p->a[5], p->color);
+            break;
+        case OP_FILL_TRIANGLE:
+            GFX_fillTriangle(gfx, x, y, w, h, r, p->a[5], p->color);
+            break;
+        case OP_BITMAP:
+            GFX_drawBitmap(gfx, x, y, m_bitmap, w, h, p->color, r);
+            break;
+        case OP_TEXT:
+            GFX_setFont(gfx, r ? u8g2_font_wqy12b_t_lunar : u8g2_font_wqy9_t_lunar);
+            GFX_setTextColor(gfx, p->color, p->color == GFX_WHITE ? GFX_BLACK : GFX_WHITE);
+            GFX_setFontDirection(gfx, w & 3);
+            GFX_setCursor(gfx, x, y);
+            GFX_printf(gfx, "%d年%d月%d日", 2000 + h, 1 + h % 12, 1 + h % 28);
+            break;
+    }
+}
+
+static void page_copy(uint8_t *black, uint8_t *color, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    memcpy(&m_out[0][y * STRIDE], black, h * STRIDE);
+    if (color != NULL)
+        memcpy(&m_out[1][y * STRIDE], color, h * STRIDE);
+}
+
+/**< Renders in pages of @p rows, a full frame if it is HEIGHT, with page bins if @p bins is set */
+static void gfx_render_bins(bool color, GFX_Rotate r, uint16_t rows, const prim_t *p, uint16_t n,
+                            uint8_t *bins, uint16_t bins_size)
+{
+    Adafruit_GFX gfx;
+
+    memset(m_out, 0xFF, sizeof(m_out));
+    if (color)
+        CHECK(GFX_begin_3c(&gfx, WIDTH, HEIGHT, m_page, STRIDE * rows * 2));
+    else
+        CHECK(GFX_begin(&gfx, WIDTH, HEIGHT, m_page, STRIDE * rows));
+    GFX_setRotation(&gfx, r);
+    if (bins != NULL)
+        GFX_setPageBins(&gfx, bins, bins_size);
+    GFX_firstPage(&gfx);
+    do {
+        for (uint16_t i = 0; i < n; i++)
+            gfx_draw(&gfx, &p[i]);
+    } while (GFX_nextPage(&gfx, page_copy));
+    GFX_end(&gfx);
+}
+
+static void gfx_render(bool color, GFX_Rotate r, uint16_t rows, const prim_t *p, uint16_t n)
+{
+    gfx_render_bins(color, r, rows, p, n, NULL, 0);
+}
+
+static uint32_t m_seed = 1;
+
+static int16_t random_in(int16_t lo, int16_t hi)
+{
+    m_seed = m_seed * 1103515245 + 12345;
+    return lo + (int16_t)((m_seed >> 16) % (uint32_t)(hi - lo + 1));
+}
+
+/**< @p n primitives of the ops up to @p last, partly off screen */
+static void random_scene(prim_t *p, uint16_t n, op_t last)
+{
+    static const uint16_t colors[] = {GFX_BLACK, GFX_WHITE, GFX_RED};
+
+    for (uint16_t i = 0; i < n; i++) {
+        p[i].op = (op_t)random_in(OP_PIXEL, last);
+        p[i].color = colors[random_in(0, 2)];
+        p[i].a[0] = random_in(-20, WIDTH + 20);
+        p[i].a[1] = random_in(-20, WIDTH + 20);
+        switch (p[i].op) {
+            case OP_LINE:
+            case OP_TRIANGLE:
+            case OP_FILL_TRIANGLE:
+                for (uint8_t k = 2; k < 6; k++)
+                    p[i].a[k] = random_in(-30, WIDTH + 30);
+                break;
+            case OP_BITMAP:
+                p[i].a[2] = random_in(1, BITMAP_WIDTH);
+                p[i].a[3] = random_in(1, BITMAP_HEIGHT);
+                p[i].a[4] = random_in(0, 1);
+                break;
+            default:
+                p[i].a[2] = random_in(-5, 40);
+                p[i].a[3] = random_in(-5, 40);
+                p[i].a[4] = random_in(0, 25);
+                break;
+        }
+    }
+}
+
+/**< Draws @p p both ways in every rotation and color mode, prints the first difference */
+static bool compare(const prim_t *p, uint16_t n, const char *what)
+{
+    for (uint8_t color = 0; color < 2; color++) {
+        for (uint8_t r = GFX_ROTATE_0; r <= GFX_ROTATE_270; r++) {
+            ref_begin(color, r);
+            for (uint16_t i = 0; i < n; i++)
+                ref_draw(&p[i]);
+            gfx_render(color, r, PAGE_ROWS, p, n);
+            if (memcmp(m_out, m_ref, sizeof(m_ref)) != 0) {
+                fprintf(stderr, "  %s (%d %d %d %d %d) differs, %s rotation %d\n", what,
+                        p[n - 1].a[0], p[n - 1].a[1], p[n - 1].a[2], p[n - 1].a[3], p[n - 1].a[4],
+                        color ? "red" : "black", r * 90);
+                test_failures++;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/******************************************************************************
+function: Tests
+******************************************************************************/
+/**< Lengths of 0 or less draw back to the start point like the Bresenham line did */
+static void test_lines(void)
+{
+    static const int16_t pos[] = {-3, 0, 5, 7, 8, 15, 40, WIDTH - 1, WIDTH + 2};
+
+    for (uint8_t i = 0; i < sizeof(pos) / sizeof(pos[0]); i++) {
+        for (int16_t len = -10; len <= 20; len++) {
+            prim_t h = {OP_HLINE, {pos[i], pos[i] % HEIGHT, len}, GFX_BLACK};
+            prim_t v = {OP_VLINE, {pos[i] % HEIGHT, pos[i], 0, len}, GFX_RED};
+            if (!compare(&h, 1, "hline") || !compare(&v, 1, "vline")) return;
+        }
+    }
+}
+
+static void test_rects(void)
+{
+    for (int16_t w = -3; w <= 12; w++) {
+        for (int16_t h = -3; h <= 12; h++) {
+            prim_t fill[] = {
+                {OP_FILL_RECT, {0, 0, WIDTH, HEIGHT}, GFX_BLACK},
+                {OP_FILL_RECT, {6, 5, w, h}, GFX_WHITE},
+            };
+            prim_t rect = {OP_RECT, {WIDTH - 9, HEIGHT - 7, w, h}, GFX_RED};
+            if (!compare(fill, 2, "fill rect") || !compare(&rect, 1, "rect")) return;
+        }
+    }
+}
+
+/**< Low rectangles give the corner helpers negative lengths */
+static void test_round_rects(void)
+{
+    for (int16_t w = 0; w <= 14; w++) {
+        for (int16_t h = 0; h <= 14; h++) {
+            for (int16_t r = 0; r <= 7; r++) {
+                prim_t fill = {OP_FILL_ROUND_RECT, {9, 30, w, h, r}, GFX_RED};
+                prim_t draw = {OP_ROUND_RECT, {-2, 3, w, h, r}, GFX_BLACK};
+                if (!compare(&fill, 1, "fill round rect") || !compare(&draw, 1, "round rect")) return;
+            }
+        }
+    }
+}
+
+/**< The page height is the rows that fit, a buffer without a whole row is refused */
+static void test_begin(void)
+{
+    Adafruit_GFX gfx;
+    char text[100];
+
+    CHECK(!GFX_begin(&gfx, WIDTH, HEIGHT, m_page, STRIDE - 1));
+    CHECK(!GFX_begin_3c(&gfx, WIDTH, HEIGHT, m_page, STRIDE * 2 - 1));
+    CHECK(!GFX_begin(&gfx, 0, HEIGHT, m_page, sizeof(m_page)));
+
+    CHECK(GFX_begin(&gfx, WIDTH, HEIGHT, m_page, STRIDE * 3 - 1));
+    CHECK_EQ(gfx.page_height, 2);
+    CHECK_EQ(gfx.total_pages, HEIGHT / 2);
+    CHECK(GFX_begin_3c(&gfx, WIDTH, HEIGHT, m_page, STRIDE * 2));
+    CHECK_EQ(gfx.page_height, 1);
+    CHECK(gfx.color == m_page + STRIDE);
+    CHECK(GFX_begin(&gfx, WIDTH, HEIGHT, m_page, 0x10000 * STRIDE));   // more rows than an int16_t holds
+    CHECK_EQ(gfx.page_height, HEIGHT);
+    CHECK_EQ(gfx.total_pages, 1);
+
+    // one row pages
+    static prim_t scene[40];
+    random_scene(scene, 40, OP_BITMAP);
+    for (uint8_t color = 0; color < 2; color++) {
+        ref_begin(color, GFX_ROTATE_90);
+        for (uint16_t i = 0; i < 40; i++)
+            ref_draw(&scene[i]);
+        gfx_render(color, GFX_ROTATE_90, 1, scene, 40);
+        CHECK(memcmp(m_out, m_ref, sizeof(m_ref)) == 0);
+    }
+
+    // strings past the stack buffer of GFX_printf are printed whole
+    memset(text, '1', sizeof(text) - 1);
+    text[sizeof(text) - 1] = 0;
+    CHECK(GFX_begin(&gfx, WIDTH, HEIGHT, m_page, sizeof(m_page)));
+    GFX_setFont(&gfx, u8g2_font_wqy9_t_lunar);
+    GFX_firstPage(&gfx);
+    CHECK_EQ(GFX_printf(&gfx, "%s", text), sizeof(text) - 1);
+    GFX_end(&gfx);
+}
+
+/**< Every pixel in and around the screen through the bound writer equals the rotation switch */
+static void test_writers(void)
+{
+    static prim_t scene[(WIDTH + 8) * (WIDTH + 8) + 4];
+    static const uint16_t colors[] = {GFX_BLACK, GFX_WHITE, GFX_RED};
+    uint16_t n = 0;
+
+    scene[n++] = (prim_t){OP_FILL_RECT, {0, 0, WIDTH, WIDTH}, GFX_RED};
+    for (int16_t y = -4; y < WIDTH + 4; y++)
+        for (int16_t x = -4; x < WIDTH + 4; x++)
+            scene[n++] = (prim_t){OP_PIXEL, {x, y}, colors[random_in(0, 2)]};
+    scene[n++] = (prim_t){OP_PIXEL, {-32768, 0}, GFX_BLACK};
+    scene[n++] = (prim_t){OP_PIXEL, {0, 32767}, GFX_BLACK};
+    scene[n++] = (prim_t){OP_PIXEL, {32767, -32768}, GFX_BLACK};
+    compare(scene, n, "pixels");
+}
+
+/**< Clipped to each page, lines and shapes keep the pixels of the unclipped code */
+static void test_clipping(void)
+{
+    static prim_t scene[40];
+
+    for (uint8_t k = 0; k < 50; k++) {
+        random_scene(scene, 40, OP_BITMAP);
+        if (!compare(scene, 40, "scene")) return;
+    }
+
+    // long lines and big shapes crossing every page, each on its own
+    for (uint16_t k = 0; k < 400; k++) {
+        random_scene(scene, 1, OP_BITMAP);
+        if (scene[0].op == OP_LINE || scene[0].op == OP_TRIANGLE || scene[0].op == OP_FILL_TRIANGLE)
+            for (uint8_t i = 0; i < 6; i++)
+                scene[0].a[i] = scene[0].a[i] * 8 - 4 * WIDTH;
+        else
+            scene[0].a[4] *= 3;
+        if (!compare(scene, 1, "primitive")) return;
+    }
+}
+
+/**< Binned pages equal unbinned ones, also when the bins run out */
+static void test_bins(void)
+{
+    static prim_t scene[60];
+    static uint8_t unbinned[2][FRAME_SIZE];
+    static uint8_t bins[sizeof(scene) / sizeof(scene[0])];
+    static const uint16_t sizes[] = {sizeof(bins), 20, 0};
+
+    for (uint8_t k = 0; k < 30; k++) {
+        random_scene(scene, 60, OP_TEXT);
+        for (uint8_t color = 0; color < 2; color++) {
+            for (uint8_t r = GFX_ROTATE_0; r <= GFX_ROTATE_270; r++) {
+                gfx_render(color, r, PAGE_ROWS, scene, 60);
+                memcpy(unbinned, m_out, sizeof(m_out));
+                for (uint8_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+                    gfx_render_bins(color, r, PAGE_ROWS, scene, 60, bins, sizes[s]);
+                    if (memcmp(m_out, unbinned, sizeof(m_out)) != 0) {
+                        fprintf(stderr, "  scene %d with %d bins differs, %s rotation %d\n", k, sizes[s],
+                                color ? "red" : "black", r * 90);
+                        test_failures++;
+                        return;
+                    }
+                }
+            }
+        }
+    }
+
+    // a primitive on the first page only is recorded as pages 0 to 0, one off screen as first > last
+    prim_t two[] = {{OP_PIXEL, {3, 2}, GFX_BLACK}, {OP_PIXEL, {-1, 2}, GFX_BLACK}};
+    gfx_render_bins(false, GFX_ROTATE_0, PAGE_ROWS, two, 2, bins, sizeof(bins));
+    CHECK_EQ(bins[0], 0x00);
+    CHECK((bins[1] >> 4) > (bins[1] & 0x0F));
+}
+
+int main(void)
+{
+    TEST_RUN(test_begin);
+    TEST_RUN(test_lines);
+    TEST_RUN(test_rects);
+    TEST_RUN(test_round_rects);
+    TEST_RUN(test_writers);
+    TEST_RUN(test_clipping);
+    TEST_RUN(test_bins);
+    TEST_EXIT();
+}
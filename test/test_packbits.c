@@ -0,0 +1,243 @@
+/*****************************************************************************
+* | File        : test_packbits.c
+* | Function    : PackBits round trip from the web page to EPD ram
+* | Info        :
+*   The corpus is encoded by packbits() of html/js/main.js (see packbits.js)
+*   and written through EPD_ble.c the way the page sends it, then read back
+*   from the UC8176 simulator.
+*
+******************************************************************************/
+
+#include <string.h>
+#include "sdk_host.h"
+#include "test.h"
+
+typedef struct
+{
+    const char    *name;
+    const uint8_t *raw;
+    uint16_t       raw_len;
+    const uint8_t *packed;
+    uint16_t       packed_len;
+    uint32_t       crc;                               /**< crc32() of main.js over raw */
+} packbits_case_t;
+
+#include "packbits_corpus.h"
+
+#define CORPUS_SIZE    (sizeof(m_corpus) / sizeof(m_corpus[0]))
+#define ROW_BYTES      50
+#define PLANE          0x13
+#define SEQ_CHUNK      (BLE_EPD_MAX_DATA_LEN - 2)   /**< IMAGE_DATA payload of main.js */
+
+static ble_epd_t m_epd;
+static uint8_t   m_background[ROW_BYTES * 300];         /**< the 4.2" panel, 400x300 */
+
+static void send(const uint8_t * p_data, uint16_t length)
+{
+    host_notify_clear();
+    host_write(&m_epd, p_data, length);
+    host_sched_run();
+}
+
+static void image_begin(uint16_t rows, uint16_t len, uint8_t encoding, uint8_t flags, uint32_t crc)
+{
+    uint8_t cmd[] = {EPD_CMD_WRITE_IMAGE, PLANE, 0, 0, 0, 0, 400 >> 8, 400 & 0xFF,
+                     rows >> 8, rows & 0xFF, len >> 8, len & 0xFF, encoding, flags,
+                     crc >> 24, crc >> 16, crc >> 8, crc};
+    send(cmd, flags & EPD_IMAGE_SEQUENCED ? sizeof(cmd) : 13);
+}
+
+/**< Data without a command byte, in packets of @p chunk bytes */
+static void image_stream(const uint8_t * p_data, uint16_t length, uint8_t chunk)
+{
+    for (uint16_t i = 0; i < length; i += chunk)
+        send(&p_data[i], length - i < chunk ? length - i : chunk);
+}
+
+/**< IMAGE_DATA packets as epdWriteImage() of main.js sends them */
+static void image_sequenced(const uint8_t * p_data, uint16_t length)
+{
+    uint8_t packet[BLE_EPD_MAX_DATA_LEN];
+    uint8_t seq = 0;
+
+    for (uint16_t i = 0; i < length; i += SEQ_CHUNK)
+    {
+        uint16_t n = length - i < SEQ_CHUNK ? length - i : SEQ_CHUNK;
+        packet[0] = EPD_CMD_IMAGE_DATA;
+        packet[1] = seq++;
+        memcpy(&packet[2], &p_data[i], n);
+        send(packet, n + 2);
+    }
+}
+
+static const uint8_t * ram(void)
+{
+    DEV_SPI_Flush();                                  // the last burst may still be open
+    return epd_sim_ram(1);
+}
+
+static void disconnect(void)
+{
+    DEV_Module_Exit();
+    host_disconnect(&m_epd);
+    host_sched_run();
+}
+
+static void connect(void)
+{
+    const uint8_t init[] = {EPD_CMD_INIT};
+
+    host_power_on();
+    host_epd_init(&m_epd);
+    host_connect(&m_epd);
+    host_notify_enable(&m_epd);
+    DEV_Module_Init();                                // main.c does it on connection
+    send(init, sizeof(init));
+
+    for (uint16_t i = 0; i < sizeof(m_background); i++)
+        m_background[i] = (i * 7 + 3) ^ 0x5A;
+}
+
+static void fill_background(uint16_t rows)
+{
+    image_begin(rows, rows * ROW_BYTES, EPD_IMAGE_RAW, 0, 0);
+    image_stream(m_background, rows * ROW_BYTES, BLE_EPD_MAX_DATA_LEN);
+}
+
+static void test_sequenced(void)
+{
+    connect();
+    for (uint8_t i = 0; i < CORPUS_SIZE; i++)
+    {
+        const packbits_case_t * c = &m_corpus[i];
+
+        fill_background(c->raw_len / ROW_BYTES);
+        image_begin(c->raw_len / ROW_BYTES, c->packed_len, EPD_IMAGE_PACKBITS, EPD_IMAGE_SEQUENCED, c->crc);
+        image_sequenced(c->packed, c->packed_len);
+
+        const host_notify_t * p_status = host_notify_last(EPD_NOTIFY_IMAGE_STATUS);
+        CHECK(p_status != NULL);
+        if (p_status == NULL || p_status->data[1] != EPD_IMAGE_OK)
+            fprintf(stderr, "  %s: not OK\n", c->name);
+        CHECK_EQ(m_epd.image.written, c->raw_len);
+        if (memcmp(ram(), c->raw, c->raw_len) != 0)
+        {
+            fprintf(stderr, "  %s: ram differs\n", c->name);
+            test_failures++;
+        }
+    }
+    CHECK_EQ(epd_sim_stats()->bus_errors, 0);
+    disconnect();
+}
+
+static void test_stream(void)
+{
+    static const uint8_t chunks[] = {BLE_EPD_MAX_DATA_LEN, BLE_EPD_MAX_DATA_LEN - 1, 1};
+
+    connect();
+    for (uint8_t k = 0; k < sizeof(chunks); k++)
+    {
+        for (uint8_t i = 0; i < CORPUS_SIZE; i++)
+        {
+            const packbits_case_t * c = &m_corpus[i];
+
+            fill_background(c->raw_len / ROW_BYTES);
+            image_begin(c->raw_len / ROW_BYTES, c->packed_len, EPD_IMAGE_PACKBITS, 0, 0);
+            image_stream(c->packed, c->packed_len, chunks[k]);
+
+            CHECK_EQ(m_epd.image.remaining, 0);
+            CHECK_EQ(m_epd.image.written, c->raw_len);
+            if (memcmp(ram(), c->raw, c->raw_len) != 0)
+            {
+                fprintf(stderr, "  %s in %d byte packets: ram differs\n", c->name, chunks[k]);
+                test_failures++;
+            }
+        }
+    }
+    CHECK_EQ(epd_sim_stats()->bus_errors, 0);
+    disconnect();
+}
+
+static const packbits_case_t * corpus_find(const char * name)
+{
+    for (uint8_t i = 0; i < CORPUS_SIZE; i++)
+        if (strcmp(m_corpus[i].name, name) == 0) return &m_corpus[i];
+    return NULL;
+}
+
+/**< The window announces fewer encoded bytes than the encoder produced */
+static void test_truncated_len(void)
+{
+    static const char * names[] = {"run 128 literal 128", "literal 129 run 2 literal 1", "random runs"};
+
+    connect();
+    for (uint8_t n = 0; n < sizeof(names) / sizeof(names[0]); n++)
+    {
+        const packbits_case_t * c = corpus_find(names[n]);
+        uint16_t rows = c->raw_len / ROW_BYTES;
+        uint16_t last = 0;
+
+        for (uint16_t cut = 1; cut <= c->packed_len; cut++)
+        {
+            fill_background(rows);
+            image_begin(rows, cut, EPD_IMAGE_PACKBITS, 0, 0);
+            image_stream(c->packed, cut, BLE_EPD_MAX_DATA_LEN);
+
+            // the window closes after len bytes, with a prefix of the image in ram
+            uint16_t written = m_epd.image.written;
+            CHECK_EQ(m_epd.image.remaining, 0);
+            CHECK_EQ(m_epd.status.state, EPD_STATE_IDLE);
+            CHECK(written >= last && written <= c->raw_len);
+            CHECK(memcmp(ram(), c->raw, written) == 0);
+            CHECK(memcmp(ram() + written, m_background + written, c->raw_len - written) == 0);
+            last = written;
+        }
+        CHECK_EQ(last, c->raw_len);
+
+        // a run cut after its header does not leak into the next window
+        fill_background(rows);
+        image_begin(rows, c->packed_len, EPD_IMAGE_PACKBITS, 0, 0);
+        image_stream(c->packed, c->packed_len, BLE_EPD_MAX_DATA_LEN);
+        CHECK(memcmp(ram(), c->raw, c->raw_len) == 0);
+    }
+    disconnect();
+}
+
+/**< The data stops early, or the window is shorter than the CRC covers */
+static void test_truncated_sequenced(void)
+{
+    const packbits_case_t * c = corpus_find("text plane");
+    const uint8_t display[] = {EPD_CMD_DISPLAY};
+    uint16_t rows = c->raw_len / ROW_BYTES;
+    uint16_t tail = c->packed_len % SEQ_CHUNK ? c->packed_len % SEQ_CHUNK : SEQ_CHUNK;
+
+    connect();
+
+    // the last IMAGE_DATA packet never arrives: no refresh of a half image
+    image_begin(rows, c->packed_len, EPD_IMAGE_PACKBITS, EPD_IMAGE_SEQUENCED, c->crc);
+    image_sequenced(c->packed, c->packed_len - tail);
+    CHECK_EQ(m_epd.image.remaining, tail);
+    CHECK_EQ(m_epd.image.status, EPD_IMAGE_INCOMPLETE);
+    uint32_t refreshes = epd_sim_stats()->refreshes;
+    send(display, sizeof(display));
+    CHECK_EQ(m_epd.status.error, EPD_ERROR_DISPLAY_REFUSED);
+    CHECK_EQ(host_notify_last(EPD_NOTIFY_IMAGE_STATUS)->data[1], EPD_IMAGE_INCOMPLETE);
+    CHECK_EQ(epd_sim_stats()->refreshes, refreshes);
+
+    // a window one byte short decodes less than the CRC covers
+    image_begin(rows, c->packed_len - 1, EPD_IMAGE_PACKBITS, EPD_IMAGE_SEQUENCED, c->crc);
+    image_sequenced(c->packed, c->packed_len - 1);
+    CHECK(host_notify_last(EPD_NOTIFY_IMAGE_STATUS) != NULL);
+    CHECK_EQ(host_notify_last(EPD_NOTIFY_IMAGE_STATUS)->data[1], EPD_IMAGE_CRC_ERROR);
+    CHECK(m_epd.image.written < c->raw_len);
+    disconnect();
+}
+
+int main(void)
+{
+    TEST_RUN(test_sequenced);
+    TEST_RUN(test_stream);
+    TEST_RUN(test_truncated_len);
+    TEST_RUN(test_truncated_sequenced);
+    TEST_EXIT();
+}
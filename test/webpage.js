@@ -0,0 +1,140 @@
+// Runs the BLE side of html/js/main.js against a fake characteristic: the
+// notifications go through the page's own handler and every write is logged.
+//   node webpage.js
+const fs = require('fs');
+const path = require('path');
+const vm = require('vm');
+
+// every element the page looks up, created on first use
+const elements = {};
+function element(id) {
+  if (!elements[id])
+    elements[id] = { id, value: '', innerHTML: '', scrollTop: 0, disabled: null, getElementsByTagName: () => [] };
+  return elements[id];
+}
+
+const page = {
+  console, setTimeout, clearTimeout,
+  confirm: () => true,
+  document: { body: {}, getElementById: element },
+};
+vm.createContext(page);
+vm.runInContext(fs.readFileSync(path.join(__dirname, '../html/js/main.js'), 'utf8'), page);
+
+let written = [];
+let onNotify = null;
+
+const characteristic = {
+  addEventListener: (type, fn) => { if (type === 'characteristicvaluechanged') onNotify = fn; },
+  startNotifications: async () => {},
+  writeValueWithResponse: async (value) => { written.push(Array.from(value)); },
+  writeValueWithoutResponse: async (value) => { written.push(Array.from(value)); },
+};
+const server = {
+  connected: true,
+  getPrimaryService: async () => ({ getCharacteristic: async () => characteristic }),
+};
+page.device = { name: 'NRF_EPD_TEST', gatt: { connected: true, connect: async () => server, disconnect: () => {} } };
+
+function notify(bytes) {
+  onNotify({ target: { value: new DataView(Uint8Array.from(bytes).buffer) } });
+}
+
+// lets the pending promise callbacks of the page run
+function settle() {
+  return new Promise((resolve) => setImmediate(resolve));
+}
+
+function run(code) {
+  return vm.runInContext(code, page);
+}
+
+let failures = 0;
+function check(cond, what) {
+  if (!cond) {
+    console.error(`webpage.js: check failed: ${what}`);
+    failures++;
+  }
+}
+
+async function test(fn) {
+  const before = failures;
+  await fn();
+  console.log(`${failures === before ? 'PASS' : 'FAIL'} ${fn.name}`);
+}
+
+async function test_write_unconnected() {
+  check(await page.write(0x01, [0x01]) === false, 'write() without a characteristic returns false');
+}
+
+async function test_connect_waits_for_credits() {
+  written = [];
+  run('bleDevice = device');
+  const connecting = page.connect();
+  await settle();
+  check(onNotify !== null, 'connect() listens for notifications');
+  check(written.length === 0, 'INIT waits for the first CREDITS');
+
+  notify([0x01, 2]);                                   // CREDITS
+  await connecting;
+  check(written.length === 1 && written[0][0] === 0x01, 'INIT is sent once credited');
+}
+
+async function test_write_takes_credits() {
+  written = [];
+  check(await page.write(0x01, [0x01]) === true, 'write() with a credit left');
+  check(written.length === 1 && written[0].join() === '1,1', 'the packet is written as given');
+
+  let done = false;
+  const pending = page.write(0x05, null).then((ok) => { done = ok; });
+  await settle();
+  check(!done && written.length === 1, 'write() waits when out of credits');
+
+  notify([0x01, 1]);
+  await pending;
+  check(done && written.length === 2 && written[1][0] === 0x05, 'a CREDITS notification releases the write');
+}
+
+async function test_write_disconnect() {
+  written = [];
+  const pending = page.write(0x02, null);
+  await settle();
+  page.disconnect();
+  check(await pending === false, 'a write waiting for credits fails on disconnect');
+  check(written.length === 0, 'nothing is written after disconnect');
+}
+
+function frame(token) {
+  return [0x02, 0xc0, 0x11, 0x22, 0x33, 0x44, 0x55, ...page.u32ToBytes(token)];
+}
+
+async function test_frame_token() {
+  const connecting = page.connect();
+  await settle();
+  notify([0x01, 8]);
+  await connecting;
+
+  // a delta is only sent against the token the device reported last
+  notify(frame(0x12345678));
+  check(run('deviceFrame') === 0x12345678, 'FRAME sets the token');
+  notify(frame(0));
+  check(run('deviceFrame') === 0, 'FRAME with 0 drops it');
+
+  // and commands that overwrite EPD ram drop it before they go out
+  for (const send of [page.clearScreen, page.setDriver, page.syncTime, page.sendcmd]) {
+    notify(frame(0x12345678));
+    element('cmdTXT').value = '0391';
+    await send();
+    check(run('deviceFrame') === 0, `${send.name}() drops the token`);
+  }
+  page.disconnect();
+}
+
+(async () => {
+  await test(test_write_unconnected);
+  await test(test_connect_waits_for_credits);
+  await test(test_write_takes_credits);
+  await test(test_write_disconnect);
+  await test(test_frame_token);
+  process.exit(failures === 0 ? 0 : 1);
+})();